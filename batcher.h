@@ -0,0 +1,105 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "hotels.h"
+#include "parser.h"
+
+namespace hotel_processing {
+
+/**
+ * The request_batcher class
+ *
+ * Feeds consecutive BOOKs and consecutive queries to the context in batches. Every batch ends
+ * with on_batch(answers): a query batch passes its answers, one value per query and window in
+ * the context windows order, a book batch passes none.
+ */
+template<typename Context, typename OnBatch>
+class request_batcher
+{
+public:
+    static constexpr size_t BATCH_SIZE = 4096;
+
+    request_batcher(Context& ctx, OnBatch on_batch)
+        : m_ctx(ctx), m_on_batch(std::move(on_batch)), m_windows(ctx.windows().size())
+    {
+    }
+
+    ~request_batcher() { flush(); }
+
+    request_batcher(const request_batcher&)            = delete;
+    request_batcher& operator=(const request_batcher&) = delete;
+
+    // Parsed request: BOOKs register their hotel, queries only look it up
+    void add(const request& req)
+    {
+        switch (req.kind) {
+            case request_kind::book:
+                book({req.time, m_ctx.intern(req.hotel), req.client, req.rooms});
+                break;
+            case request_kind::clients:
+            case request_kind::rooms: {
+                auto hotel = m_ctx.find(req.hotel);
+                query(req.kind == request_kind::clients ? query_kind::clients : query_kind::rooms,
+                      hotel ? *hotel : INVALID_HOTEL);
+                break;
+            }
+            case request_kind::unknown:
+                break;
+        }
+    }
+
+    void book(const book_request& req)
+    {
+        if (!m_queries.empty())
+            flush_queries();
+        m_books.push_back(req);
+        if (m_books.size() == BATCH_SIZE)
+            flush_books();
+    }
+
+    // Query for all context windows, INVALID_HOTEL is answered with zeroes
+    void query(query_kind kind, hotel_id_t hotel)
+    {
+        if (!m_books.empty())
+            flush_books();
+        for (uint32_t w = 0; w < m_windows; ++w) {
+            m_queries.push_back({kind, hotel, w});
+        }
+        if (m_queries.size() >= BATCH_SIZE)
+            flush_queries();
+    }
+
+    void flush()
+    {
+        flush_books();
+        flush_queries();
+    }
+
+private:
+    void flush_books()
+    {
+        m_ctx.book_batch(m_books);
+        m_books.clear();
+        m_on_batch(std::span<const size_t>{});
+    }
+
+    void flush_queries()
+    {
+        m_answers.resize(m_queries.size());
+        m_ctx.query_batch(m_queries, m_answers);
+        m_queries.clear();
+        m_on_batch(std::span<const size_t>{m_answers});
+    }
+
+private:
+    Context&                   m_ctx;
+    OnBatch                    m_on_batch;
+    size_t                     m_windows;
+    std::vector<book_request>  m_books;
+    std::vector<query_request> m_queries;
+    std::vector<size_t>        m_answers;
+};
+
+} // ::hotel_processing
@@ -0,0 +1,261 @@
+/**
+ *
+ * Context microbenchmarks
+ *
+ * Measures book(), clients(), rooms() and top_rooms() separately for every engine across hotel
+ * counts, window fill levels (bookings per hotel inside the window) and client cardinalities, the
+ * top case books and reports the TOP_K hotels with the most rooms. Every case is calibrated to run
+ * at least MIN_TIME per repetition, runs warmup repetitions first and reports ns/op statistics
+ * over the measured ones.
+ *
+ * Usage:
+ *    hotel-processing_bench [-r REPETITIONS] [-w WARMUP] [-t MIN_TIME_MS] [-f FILTER]
+ *
+ * Results are written to standard output as JSON, FILTER is a substring of the case name
+ * ("book/cached/hotels=100/fill=1024/clients=16").
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+#include "hotels.h"
+
+namespace dt = std::chrono;
+
+namespace {
+
+using hotel_processing::client_id_t;
+using hotel_processing::hotel_id_t;
+using hotel_processing::time_t;
+
+// Cases with more bookings inside the window are skipped
+constexpr size_t MAX_STORED = 1 << 20;
+// Random hotels and clients sequences length
+constexpr size_t SEQUENCE   = 1 << 16;
+// Hotels per top report
+constexpr size_t TOP_K      = 10;
+
+struct settings
+{
+    int             repetitions{5};
+    int             warmup{1};
+    dt::nanoseconds min_time{dt::milliseconds{20}};
+    std::string     filter;
+};
+
+struct workload
+{
+    size_t hotels;
+    size_t fill;    // bookings per hotel inside the window
+    size_t clients; // distinct clients
+};
+
+struct result
+{
+    std::string name;
+    size_t      ops{};    // per repetition
+    double      mean{};   // ns/op
+    double      median{};
+    double      min{};
+    double      max{};
+    double      stddev{};
+};
+
+/**
+ * Run `body(ops)` until it takes at least min_time, then warmup and measured repetitions with
+ * the same ops count
+ */
+template<typename Body>
+result measure(const settings& config, std::string name, Body&& body)
+{
+    auto run = [&](size_t ops) {
+        auto start = dt::steady_clock::now();
+        body(ops);
+        return dt::steady_clock::now() - start;
+    };
+
+    size_t ops = 1;
+    while (run(ops) < config.min_time && ops < (size_t(1) << 30))
+        ops *= 2;
+
+    for (int i = 0; i < config.warmup; ++i)
+        run(ops);
+
+    std::vector<double> samples;
+    for (int i = 0; i < config.repetitions; ++i)
+        samples.push_back(double(dt::nanoseconds{run(ops)}.count()) / double(ops));
+
+    std::sort(samples.begin(), samples.end());
+
+    result res{std::move(name), ops};
+    for (auto sample : samples)
+        res.mean += sample;
+    res.mean /= double(samples.size());
+    for (auto sample : samples)
+        res.stddev += (sample - res.mean) * (sample - res.mean);
+    res.stddev = std::sqrt(res.stddev / double(samples.size()));
+    res.median = samples[samples.size() / 2];
+    res.min    = samples.front();
+    res.max    = samples.back();
+    return res;
+}
+
+/**
+ * The bench_context struct
+ *
+ * Context filled up to the workload level at a steady booking rate: every booking moves time by
+ * window / (hotels * fill), so the window keeps the same number of bookings while booking goes on.
+ */
+template<typename Context>
+struct bench_context
+{
+    explicit bench_context(const workload& load) : load(load)
+    {
+        std::mt19937 gen(42);
+        for (size_t i = 0; i < SEQUENCE; ++i) {
+            hotels.push_back(hotel_id_t(gen() % load.hotels));
+            clients.push_back(client_id_t(gen() % load.clients));
+        }
+        for (size_t i = 0; i < load.hotels; ++i)
+            ctx.intern(fmt::format("hotel{}", i));
+        book(load.hotels * load.fill);
+    }
+
+    void book(size_t ops)
+    {
+        auto per_window = load.hotels * load.fill;
+        for (size_t i = 0; i < ops; ++i, ++count) {
+            auto time = time_t(count / per_window) * hotel_processing::TIME_WINDOW +
+                        time_t(count % per_window * hotel_processing::TIME_WINDOW / per_window);
+            ctx.book(time, hotels[count % SEQUENCE], clients[count % SEQUENCE], 1);
+        }
+    }
+
+    workload                 load;
+    Context                  ctx;
+    std::vector<hotel_id_t>  hotels;
+    std::vector<client_id_t> clients;
+    size_t                   count{};
+};
+
+template<typename Context>
+void bench_engine(const settings& config, std::string_view engine, const workload& load,
+                  std::vector<result>& results)
+{
+    auto name = [&](std::string_view op) {
+        return fmt::format("{}/{}/hotels={}/fill={}/clients={}", op, engine, load.hotels,
+                           load.fill, load.clients);
+    };
+    auto selected = [&](const std::string& name) {
+        return name.find(config.filter) != std::string::npos;
+    };
+
+    if (auto book = name("book"); selected(book)) {
+        bench_context<Context> bench{load};
+        results.push_back(measure(config, book, [&](size_t ops) {
+            bench.book(ops);
+        }));
+    }
+
+    // Queries do not move time, so only the first one per hotel evicts anything
+    size_t sink = 0;
+    if (auto clients = name("clients"); selected(clients)) {
+        bench_context<Context> bench{load};
+        results.push_back(measure(config, clients, [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i)
+                sink += bench.ctx.clients(bench.hotels[i % SEQUENCE]);
+        }));
+    }
+
+    if (auto rooms = name("rooms"); selected(rooms)) {
+        bench_context<Context> bench{load};
+        results.push_back(measure(config, rooms, [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i)
+                sink += bench.ctx.rooms(bench.hotels[i % SEQUENCE]);
+        }));
+    }
+
+    if (auto top = name("top"); selected(top)) {
+        bench_context<Context> bench{load};
+        results.push_back(measure(config, top, [&](size_t ops) {
+            for (size_t i = 0; i < ops; ++i) {
+                bench.book(1);
+                sink += bench.ctx.top_rooms(TOP_K).size();
+            }
+        }));
+    }
+
+    if (sink == size_t(-1))
+        std::cerr << sink;
+}
+
+void print_json(const settings& config, const std::vector<result>& results)
+{
+    std::cout << fmt::format("{{\n  \"repetitions\": {},\n  \"warmup\": {},\n  \"benchmarks\": [",
+                             config.repetitions, config.warmup);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto const& res = results[i];
+        std::cout << fmt::format(
+            "{}\n    {{\"name\": \"{}\", \"ops\": {}, \"ns_per_op\": {:.2f}, "
+            "\"median_ns_per_op\": {:.2f}, \"min_ns_per_op\": {:.2f}, \"max_ns_per_op\": {:.2f}, "
+            "\"stddev_ns_per_op\": {:.2f}, \"ops_per_sec\": {:.0f}}}",
+            i ? "," : "", res.name, res.ops, res.mean, res.median, res.min, res.max, res.stddev,
+            1e9 / res.mean);
+    }
+    std::cout << "\n  ]\n}\n";
+}
+
+void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog << " [-r REPETITIONS] [-w WARMUP] [-t MIN_TIME_MS] [-f FILTER]\n";
+}
+
+} // ::anonymous
+
+int main(int argc, char* argv[])
+{
+    settings config;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-r") && i + 1 < argc) {
+            config.repetitions = std::max(1, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "-w") && i + 1 < argc) {
+            config.warmup = std::max(0, std::atoi(argv[++i]));
+        } else if (!std::strcmp(argv[i], "-t") && i + 1 < argc) {
+            config.min_time = dt::milliseconds{std::max(1, std::atoi(argv[++i]))};
+        } else if (!std::strcmp(argv[i], "-f") && i + 1 < argc) {
+            config.filter = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<result> results;
+    for (size_t hotels : {1, 100, 10'000}) {
+        for (size_t fill : {16, 1024, 65'536}) {
+            if (hotels * fill > MAX_STORED)
+                continue;
+            for (size_t clients : {16, 1'000'000}) {
+                workload load{hotels, fill, clients};
+                bench_engine<hotel_processing::cached_context>(config, "cached", load, results);
+                bench_engine<hotel_processing::lazy_context>(config, "lazy", load, results);
+                bench_engine<hotel_processing::approx_context>(config, "approx", load, results);
+                std::cerr << fmt::format("hotels={} fill={} clients={} done\n", hotels, fill,
+                                         clients);
+            }
+        }
+    }
+
+    print_json(config, results);
+    return 0;
+}
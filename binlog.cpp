@@ -0,0 +1,158 @@
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
+
+#include "binlog.h"
+#include "parser.h"
+
+namespace hotel_processing {
+
+namespace {
+
+constexpr size_t RECORD_SIZE = sizeof(binlog_record);
+
+size_t padded(size_t size)
+{
+    return (size + RECORD_SIZE - 1) / RECORD_SIZE * RECORD_SIZE;
+}
+
+binlog_record make_record(binlog_kind kind, uint32_t delta, uint32_t hotel, uint32_t client,
+                          uint32_t rooms)
+{
+    return {uint32_t(kind) << binlog_record::KIND_SHIFT | delta, hotel, client, rooms};
+}
+
+} // ::anonymous
+
+bool write_binlog(std::string_view text, const char* path)
+{
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view>                  names;
+    std::vector<binlog_record>                     records;
+
+    auto dictionary_index = [&](std::string_view name) {
+        auto [it, inserted] = ids.emplace(name, uint32_t(names.size()));
+        if (inserted)
+            names.push_back(name);
+        return it->second;
+    };
+
+    request_parser parser{text};
+    request        req;
+    size_t         requests_count = parser.count();
+    time_t         base_time{};
+    time_t         last_time{};
+    bool           first_book = true;
+
+    records.reserve(requests_count);
+    for (size_t i = 0; i < requests_count && parser.next(req); ++i) {
+        switch (req.kind) {
+            case request_kind::book: {
+                if (req.rooms > std::numeric_limits<uint32_t>::max())
+                    return false;
+                if (first_book) {
+                    base_time = last_time = req.time;
+                    first_book = false;
+                }
+                uint32_t delta = 0;
+                if (req.time < last_time ||
+                    uint64_t(req.time - last_time) > binlog_record::MAX_DELTA) {
+                    auto time = uint64_t(req.time);
+                    records.push_back(make_record(binlog_kind::time, 0, uint32_t(time),
+                                                  uint32_t(time >> 32), 0));
+                } else {
+                    delta = uint32_t(req.time - last_time);
+                }
+                last_time = req.time;
+                records.push_back(make_record(binlog_kind::book, delta,
+                                              dictionary_index(req.hotel), req.client,
+                                              uint32_t(req.rooms)));
+                break;
+            }
+            case request_kind::clients:
+            case request_kind::rooms: {
+                auto kind = req.kind == request_kind::clients ? binlog_kind::clients
+                                                              : binlog_kind::rooms;
+                records.push_back(make_record(kind, 0, dictionary_index(req.hotel), 0, 0));
+                break;
+            }
+            case request_kind::unknown:
+                break;
+        }
+    }
+
+    std::string dictionary;
+    for (auto name : names) {
+        auto length = uint32_t(name.size());
+        dictionary.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        dictionary.append(name);
+    }
+    dictionary.resize(padded(dictionary.size()), '\0');
+
+    binlog_header header{};
+    std::memcpy(header.magic, BINLOG_MAGIC, sizeof(header.magic));
+    header.version         = BINLOG_VERSION;
+    header.hotels          = uint32_t(names.size());
+    header.records         = records.size();
+    header.base_time       = base_time;
+    header.dictionary_size = dictionary.size();
+
+    std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(dictionary.data(), std::streamsize(dictionary.size()));
+    ofs.write(reinterpret_cast<const char*>(records.data()),
+              std::streamsize(records.size() * RECORD_SIZE));
+    ofs.close();
+    return bool(ofs);
+}
+
+bool is_binlog(std::string_view data)
+{
+    return data.size() >= sizeof(BINLOG_MAGIC) &&
+           !std::memcmp(data.data(), BINLOG_MAGIC, sizeof(BINLOG_MAGIC));
+}
+
+bool binlog_reader::open(std::string_view data)
+{
+    m_names.clear();
+    m_records = {};
+
+    binlog_header header;
+    if (!is_binlog(data) || data.size() < sizeof(header))
+        return false;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.version != BINLOG_VERSION)
+        return false;
+
+    auto rest = data.substr(sizeof(header));
+    if (header.dictionary_size > rest.size() ||
+        header.records > (rest.size() - header.dictionary_size) / RECORD_SIZE ||
+        header.hotels > header.dictionary_size / sizeof(uint32_t))
+        return false;
+
+    auto dictionary = rest.substr(0, header.dictionary_size);
+    m_names.reserve(header.hotels);
+    for (uint32_t i = 0; i < header.hotels; ++i) {
+        uint32_t length;
+        if (dictionary.size() < sizeof(length))
+            return false;
+        std::memcpy(&length, dictionary.data(), sizeof(length));
+        dictionary.remove_prefix(sizeof(length));
+        if (dictionary.size() < length)
+            return false;
+        m_names.push_back(dictionary.substr(0, length));
+        dictionary.remove_prefix(length);
+    }
+
+    // Records are used in place
+    auto records = rest.data() + header.dictionary_size;
+    if (reinterpret_cast<uintptr_t>(records) % alignof(binlog_record))
+        return false;
+
+    m_base_time = header.base_time;
+    m_records   = {reinterpret_cast<const binlog_record*>(records), size_t(header.records)};
+    return true;
+}
+
+} // ::hotel_processing
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "hotels.h"
+
+namespace hotel_processing {
+
+/**
+ * Binary request log
+ *
+ * Compact replacement of the text requests format for replays. Layout, native byte order:
+ *
+ *     binlog_header
+ *     dictionary   header.hotels names, each one is uint32_t length followed by the name bytes,
+ *                  zero padded to sizeof(binlog_record)
+ *     records      header.records fixed-width binlog_record entries
+ *
+ * BOOK times are deltas from the previous booking time, the first one from header.base_time.
+ * Deltas that do not fit into a record (and times going backwards) are written as a separate
+ * TIME record with the absolute time, followed by the booking with zero delta.
+ */
+static inline constexpr char     BINLOG_MAGIC[8] = {'H', 'P', 'B', 'L', 'O', 'G', 0, 0};
+static inline constexpr uint32_t BINLOG_VERSION  = 1;
+
+struct binlog_header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t hotels;
+    uint64_t records;
+    int64_t  base_time;
+    uint64_t dictionary_size; // bytes, padding included
+    uint64_t reserved;
+};
+
+enum class binlog_kind : uint8_t
+{
+    book,
+    clients,
+    rooms,
+    time,
+};
+
+struct binlog_record
+{
+    static constexpr int      KIND_SHIFT = 30;
+    static constexpr uint32_t MAX_DELTA  = (uint32_t(1) << KIND_SHIFT) - 1;
+
+    uint32_t head;   // kind << KIND_SHIFT | time delta
+    uint32_t hotel;  // dictionary index; TIME: low half of the time
+    uint32_t client; // TIME: high half of the time
+    uint32_t rooms;
+
+    binlog_kind kind() const { return binlog_kind(head >> KIND_SHIFT); }
+    uint32_t    delta() const { return head & MAX_DELTA; }
+    // TIME records only
+    time_t      time() const { return time_t(uint64_t(client) << 32 | hotel); }
+};
+
+static_assert(sizeof(binlog_header) == 48);
+static_assert(sizeof(binlog_record) == 16);
+
+/**
+ * Convert text requests (main.cpp format) to the binary log
+ *
+ * @param text  requests count followed by the requests
+ * @param path  output file, overwritten
+ * @return false on write failures or room counts that do not fit into 32 bits
+ */
+bool write_binlog(std::string_view text, const char* path);
+
+// Data starts with the binary log magic
+bool is_binlog(std::string_view data);
+
+/**
+ * The binlog_reader class
+ *
+ * View of a binary log kept in memory, e.g. mmapped by input_buffer. Records are used in place.
+ */
+class binlog_reader
+{
+public:
+    /**
+     * @param data  whole log, must outlive the reader
+     * @return false for malformed or truncated logs
+     */
+    bool open(std::string_view data);
+
+    time_t base_time() const { return m_base_time; }
+
+    size_t           hotels() const { return m_names.size(); }
+    std::string_view hotel_name(uint32_t index) const { return m_names[index]; }
+
+    std::span<const binlog_record> records() const { return m_records; }
+
+private:
+    time_t                         m_base_time{};
+    std::vector<std::string_view>  m_names;
+    std::span<const binlog_record> m_records;
+};
+
+/**
+ * The binlog_hotels class
+ *
+ * Context IDs of the log dictionary hotels, resolved on first use. Bookings register the hotel,
+ * queries only look it up, so hotels the context already knows (e.g. loaded from a snapshot) are
+ * answered before the log books them. Hotels unknown to the context are INVALID_HOTEL.
+ */
+template<typename Context>
+class binlog_hotels
+{
+public:
+    binlog_hotels(Context& ctx, const binlog_reader& log)
+        : m_ctx(ctx), m_log(log), m_ids(log.hotels(), INVALID_HOTEL)
+    {
+    }
+
+    size_t size() const { return m_ids.size(); }
+
+    hotel_id_t book(uint32_t hotel)
+    {
+        auto& id = m_ids[hotel];
+        if (id == INVALID_HOTEL)
+            id = m_ctx.intern(m_log.hotel_name(hotel));
+        return id;
+    }
+
+    hotel_id_t query(uint32_t hotel)
+    {
+        auto& id = m_ids[hotel];
+        if (id == INVALID_HOTEL) {
+            if (auto found = m_ctx.find(m_log.hotel_name(hotel)))
+                id = *found;
+        }
+        return id;
+    }
+
+private:
+    Context&                m_ctx;
+    const binlog_reader&    m_log;
+    std::vector<hotel_id_t> m_ids;
+};
+
+} // ::hotel_processing
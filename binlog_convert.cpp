@@ -0,0 +1,40 @@
+/**
+ *
+ * Text to binary request log converter
+ *
+ * Usage:
+ *    binlog_convert INPUT OUTPUT
+ *
+ * INPUT is in the main.cpp text format, "-" reads standard input. OUTPUT can be replayed with
+ * hotel-processing OUTPUT.
+ *
+ */
+
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+
+#include "binlog.h"
+#include "parser.h"
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " INPUT OUTPUT\n";
+        return 1;
+    }
+
+    hotel_processing::input_buffer input;
+    if (!(std::strcmp(argv[1], "-") ? input.open(argv[1]) : input.open(STDIN_FILENO))) {
+        std::cerr << "Can't read input\n";
+        return 1;
+    }
+
+    if (!hotel_processing::write_binlog(input.data(), argv[2])) {
+        std::cerr << "Can't write binary log\n";
+        return 1;
+    }
+
+    return 0;
+}
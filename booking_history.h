@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+#include "flat_map.h"
+#include "snapshot.h"
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The booking_history class
+ *
+ * Time-indexed bookings of a hotel for range queries over the retained interval, both in
+ * O(log n):
+ *
+ *  - rooms: prefix sums of the room counts, the range is found by binary search on time.
+ *  - distinct clients: persistent segment tree over booking positions. Booking i stores the key
+ *    prev(i) + 1, where prev(i) is the position of the previous booking of the same client (-1 if
+ *    none), and version v of the tree holds the keys of the first v bookings. Bookings [l, r) have
+ *    as many distinct clients as bookings there with prev < l: the count of keys <= l in version
+ *    r minus the one in version l.
+ *
+ * Positions live in [0, 2^bits). When they run out, bookings older than the retention horizon
+ * are dropped and the index is rebuilt with room for at least as many new bookings as retained,
+ * so appends stay O(log n) amortized.
+ *
+ * Bookings are indexed in arrival order: one older than the latest booking is indexed at the
+ * latest booking time.
+ */
+template<typename Time, typename Client, typename Rooms>
+class booking_history
+{
+public:
+    static_assert(sizeof(Client) <= sizeof(uint32_t));
+
+    static constexpr unsigned MIN_BITS = 6;
+    static constexpr unsigned MAX_BITS = 31;
+
+    explicit booking_history(std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+        m_times(memory),
+        m_clients(memory),
+        m_rooms(1, 0, memory),
+        m_roots(1, 0, memory),
+        m_nodes(1, node{0, 0, 0}, memory),
+        m_last(memory)
+    {
+    }
+
+    size_t size() const { return m_times.size(); }
+
+    /**
+     * Append the booking
+     *
+     * @param retention  bookings with time <= latest booking time - retention may be dropped
+     */
+    void add(Time time, Client client, Rooms rooms, Time retention)
+    {
+        if (!m_times.empty())
+            time = std::max(time, m_times.back());
+        if (size() == (size_t(1) << m_bits))
+            compact(time - retention);
+
+        auto pos  = uint32_t(size());
+        auto prev = m_last.find(uint32_t(client)); // previous position + 1, 0 if none
+        m_last.set(uint32_t(client), pos + 1);
+
+        m_times.push_back(time);
+        m_clients.push_back(client);
+        m_rooms.push_back(m_rooms.back() + uint64_t(rooms));
+        m_roots.push_back(insert(m_roots.back(), prev));
+    }
+
+    // Rooms booked with from < time <= to
+    uint64_t rooms(Time from, Time to) const
+    {
+        auto [first, last] = range(from, to);
+        return m_rooms[last] - m_rooms[first];
+    }
+
+    // Distinct clients booked with from < time <= to
+    size_t clients(Time from, Time to) const
+    {
+        auto [first, last] = range(from, to);
+        if (first == last)
+            return 0;
+        return count_below(m_roots[last], first + 1) - count_below(m_roots[first], first + 1);
+    }
+
+    void save(snapshot_writer& out) const
+    {
+        out.value(uint64_t(m_bits));
+        out.value(uint64_t(size()));
+        out.value(uint64_t(m_nodes.size()));
+        out.array(m_times.data(), m_times.size());
+        out.array(m_clients.data(), m_clients.size());
+        out.array(m_rooms.data(), m_rooms.size());
+        out.array(m_roots.data(), m_roots.size());
+        out.array(m_nodes.data(), m_nodes.size());
+        m_last.save(out);
+    }
+
+    // Replaces the history content
+    bool load(snapshot_reader& in)
+    {
+        uint64_t bits, size, nodes;
+        if (!in.value(bits) || !in.value(size) || !in.value(nodes) || bits < MIN_BITS ||
+            bits > MAX_BITS || size > (uint64_t(1) << bits) || !nodes ||
+            !in.fits(size, sizeof(Time) + sizeof(Client) + sizeof(uint64_t) + sizeof(uint32_t)) ||
+            !in.fits(nodes, sizeof(node)))
+            return false;
+
+        booking_history loaded{m_times.get_allocator().resource()};
+        loaded.m_bits = unsigned(bits);
+        loaded.m_times.resize(size);
+        loaded.m_clients.resize(size);
+        loaded.m_rooms.resize(size + 1);
+        loaded.m_roots.resize(size + 1);
+        loaded.m_nodes.resize(nodes);
+        if (!in.array(loaded.m_times.data(), size) || !in.array(loaded.m_clients.data(), size) ||
+            !in.array(loaded.m_rooms.data(), size + 1) ||
+            !in.array(loaded.m_roots.data(), size + 1) ||
+            !in.array(loaded.m_nodes.data(), nodes) || !loaded.m_last.load(in))
+            return false;
+
+        // Queries follow node links without checks
+        for (auto root : loaded.m_roots) {
+            if (root >= nodes)
+                return false;
+        }
+        for (auto const& n : loaded.m_nodes) {
+            if (n.left >= nodes || n.right >= nodes)
+                return false;
+        }
+        if (!std::is_sorted(loaded.m_times.begin(), loaded.m_times.end()))
+            return false;
+
+        *this = std::move(loaded);
+        return true;
+    }
+
+private:
+    struct node
+    {
+        uint32_t left;
+        uint32_t right;
+        uint32_t count;
+    };
+
+    // Positions [first, last) of the bookings with from < time <= to
+    std::pair<size_t, size_t> range(Time from, Time to) const
+    {
+        if (!(from < to))
+            return {0, 0};
+        auto first = std::upper_bound(m_times.begin(), m_times.end(), from) - m_times.begin();
+        auto last  = std::upper_bound(m_times.begin() + first, m_times.end(), to) - m_times.begin();
+        return {size_t(first), size_t(last)};
+    }
+
+    // New version with the key added, every node on the path is copied
+    uint32_t insert(uint32_t root, uint32_t key)
+    {
+        auto new_root = uint32_t(m_nodes.size());
+        auto copy     = new_root;
+        auto item     = m_nodes[root];
+        ++item.count;
+        m_nodes.push_back(item);
+
+        for (auto bit = int(m_bits) - 1; bit >= 0; --bit) {
+            auto right = (key >> bit) & 1;
+            auto child = right ? m_nodes[root].right : m_nodes[root].left;
+            auto idx   = uint32_t(m_nodes.size());
+            item       = m_nodes[child];
+            ++item.count;
+            m_nodes.push_back(item);
+            (right ? m_nodes[copy].right : m_nodes[copy].left) = idx;
+            root = child;
+            copy = idx;
+        }
+        return new_root;
+    }
+
+    // Keys less than `key` in the version
+    size_t count_below(uint32_t root, uint64_t key) const
+    {
+        if (key >> m_bits)
+            return m_nodes[root].count;
+
+        size_t count = 0;
+        for (auto bit = int(m_bits) - 1; bit >= 0 && root; --bit) {
+            if ((key >> bit) & 1) {
+                count += m_nodes[m_nodes[root].left].count;
+                root = m_nodes[root].right;
+            } else {
+                root = m_nodes[root].left;
+            }
+        }
+        return count;
+    }
+
+    // Drop bookings with time <= deadline and rebuild the index
+    void compact(Time deadline)
+    {
+        auto first =
+            size_t(std::upper_bound(m_times.begin(), m_times.end(), deadline) - m_times.begin());
+        auto count = size() - first;
+
+        std::vector<Time>     times(m_times.begin() + ptrdiff_t(first), m_times.end());
+        std::vector<Client>   clients(m_clients.begin() + ptrdiff_t(first), m_clients.end());
+        std::vector<uint64_t> rooms(count);
+        for (size_t i = 0; i < count; ++i)
+            rooms[i] = m_rooms[first + i + 1] - m_rooms[first + i];
+
+        // Room for at least as many new bookings as retained
+        m_bits = std::clamp(unsigned(std::bit_width(count * 2)), MIN_BITS, MAX_BITS);
+        m_times.clear();
+        m_clients.clear();
+        m_rooms.assign(1, 0);
+        m_roots.assign(1, 0);
+        m_nodes.assign(1, node{0, 0, 0});
+        m_last.clear();
+
+        m_times.reserve(count);
+        m_clients.reserve(count);
+        m_rooms.reserve(count + 1);
+        m_roots.reserve(count + 1);
+        m_nodes.reserve(count * (m_bits + 1) + 1);
+        for (size_t i = 0; i < count; ++i) {
+            auto pos  = uint32_t(i);
+            auto prev = m_last.find(uint32_t(clients[i]));
+            m_last.set(uint32_t(clients[i]), pos + 1);
+            m_times.push_back(times[i]);
+            m_clients.push_back(clients[i]);
+            m_rooms.push_back(m_rooms.back() + rooms[i]);
+            m_roots.push_back(insert(m_roots.back(), prev));
+        }
+    }
+
+private:
+    unsigned                   m_bits{MIN_BITS};
+    std::pmr::vector<Time>     m_times;
+    std::pmr::vector<Client>   m_clients;
+    // rooms booked before the position, size() + 1 entries
+    std::pmr::vector<uint64_t> m_rooms;
+    // tree version after the first N bookings, size() + 1 entries; node 0 is the empty tree
+    std::pmr::vector<uint32_t> m_roots;
+    std::pmr::vector<node>     m_nodes;
+    // last position + 1 by client
+    flat_map                   m_last;
+};
+
+} // ::priv
+} // ::hotel_processing
@@ -0,0 +1,448 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <bit>
+#include <limits>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "memory.h"
+#include "snapshot.h"
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The packed_column class
+ *
+ * Storage of one booking_log field. While all live values fit, they are kept as Narrow offsets
+ * from a base, otherwise as Value. The log owns the slots: it repacks the column with the bounds
+ * of its live values when a new value doesn't fit or when the storage is reallocated, so a wide
+ * column narrows again once the outliers are evicted.
+ */
+template<typename Value, typename Narrow>
+class packed_column
+{
+public:
+    using Unsigned = std::make_unsigned_t<Value>;
+
+    static constexpr Unsigned NARROW_MAX = std::numeric_limits<Narrow>::max();
+
+    bool wide() const { return bool(m_wide); }
+
+    Value get(size_t slot) const
+    {
+        if (m_wide)
+            return m_wide[slot];
+        return Value(Unsigned(m_base) + m_narrow[slot]);
+    }
+
+    // Value can be set without repacking
+    bool fits(Value value) const
+    {
+        return m_wide || (!(value < m_base) && Unsigned(value) - Unsigned(m_base) <= NARROW_MAX);
+    }
+
+    // The value must fit
+    void set(size_t slot, Value value)
+    {
+        if (m_wide)
+            m_wide[slot] = value;
+        else
+            m_narrow[slot] = Narrow(Unsigned(value) - Unsigned(m_base));
+    }
+
+    void move(size_t to, size_t from)
+    {
+        if (m_wide)
+            m_wide[to] = m_wide[from];
+        else
+            m_narrow[to] = m_narrow[from];
+    }
+
+    /**
+     * Visit stored values of the slots as a contiguous span
+     *
+     * @param f  callable with (std::span<const Narrow>) or (std::span<const Value>), values are
+     *           span elements plus base()
+     */
+    template<typename F>
+    void visit(size_t start, size_t count, F&& f) const
+    {
+        if (m_wide)
+            f(std::span<const Value>(&m_wide[start], count));
+        else
+            f(std::span<const Narrow>(&m_narrow[start], count));
+    }
+
+    // Zero for the wide column
+    Value base() const { return m_wide ? Value{} : m_base; }
+
+    /**
+     * Save the packing and the stored values of the live slots as one array
+     *
+     * @param live  callable with (F), calling F(start, count) for every live slot range in order
+     */
+    template<typename Live>
+    void save(snapshot_writer& out, Live&& live) const
+    {
+        out.value(uint64_t(wide()));
+        out.value(base());
+        live([&](size_t start, size_t count) {
+            visit(start, count, [&](auto values) { out.array_part(values.data(), values.size()); });
+        });
+        out.pad();
+    }
+
+    // Replace the column with `count` saved values in a new `capacity` slots storage
+    bool load(snapshot_reader& in, std::pmr::memory_resource* memory, size_t capacity,
+              size_t count)
+    {
+        uint64_t wide;
+        Value    base;
+        if (!in.value(wide) || !in.value(base))
+            return false;
+        if (wide) {
+            auto values = pmr_array<Value>(memory, capacity);
+            if (!in.array(values.get(), count))
+                return false;
+            m_wide = std::move(values);
+            m_narrow.reset();
+        } else {
+            auto values = pmr_array<Narrow>(memory, capacity);
+            if (!in.array(values.get(), count))
+                return false;
+            m_narrow = std::move(values);
+            m_wide.reset();
+            m_base = base;
+        }
+        return true;
+    }
+
+    /**
+     * Store the values of the live slots in [0, count) of a new `capacity` slots storage
+     * allocated from `memory`. It's narrow if [lo, hi] fits: the base leaves equal headroom below
+     * and above.
+     *
+     * @param live  callable with (F), calling F(start, count) for every live slot range in order
+     */
+    template<typename Live>
+    void repack(std::pmr::memory_resource* memory, size_t capacity, Value lo, Value hi, Live&& live)
+    {
+        auto span = Unsigned(hi) - Unsigned(lo);
+        if (span > NARROW_MAX) {
+            auto wide = pmr_array<Value>(memory, capacity);
+            auto out  = wide.get();
+            live([&](size_t start, size_t count) {
+                for (size_t i = 0; i < count; ++i)
+                    *out++ = get(start + i);
+            });
+            m_wide = std::move(wide);
+            m_narrow.reset();
+            return;
+        }
+
+        auto below  = Unsigned(lo) - Unsigned(std::numeric_limits<Value>::min());
+        auto base   = Value(Unsigned(lo) - std::min<Unsigned>((NARROW_MAX - span) / 2, below));
+        auto narrow = pmr_array<Narrow>(memory, capacity);
+        auto out    = narrow.get();
+        live([&](size_t start, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+                *out++ = Narrow(Unsigned(get(start + i)) - Unsigned(base));
+        });
+        m_narrow = std::move(narrow);
+        m_wide.reset();
+        m_base = base;
+    }
+
+private:
+    pmr_array<Narrow> m_narrow;
+    pmr_array<Value>  m_wide;
+    Value             m_base{};
+};
+
+/**
+ * The booking_log class
+ *
+ * Growable power-of-two ring buffer of bookings in structure-of-arrays layout: times, clients
+ * and room counts live in separate arrays. Bookings are appended to the back and evicted from
+ * the front; storage shrinks when the log becomes sparse.
+ *
+ * Times are stored as 32-bit offsets and room counts as 16-bit ones while the live values fit
+ * (a day of bookings always does), so a booking takes 10 bytes. Extreme values switch the column
+ * to full width until they are evicted.
+ *
+ * Storage comes from the memory resource given on construction.
+ */
+template<typename Time, typename Client, typename Rooms>
+class booking_log
+{
+public:
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    booking_log() = default;
+    explicit booking_log(std::pmr::memory_resource* memory) : m_memory(memory) {}
+
+    size_t size() const { return m_size; }
+    bool   empty() const { return m_size == 0; }
+    size_t capacity() const { return m_capacity; }
+
+    Time   time(size_t idx) const { return m_times.get(slot(idx)); }
+    Client client(size_t idx) const { return m_clients[slot(idx)]; }
+    Rooms  rooms(size_t idx) const { return m_rooms.get(slot(idx)); }
+
+    // Memory used per booking slot
+    size_t slot_size() const
+    {
+        return (m_times.wide() ? sizeof(Time) : sizeof(uint32_t)) + sizeof(Client) +
+               (m_rooms.wide() ? sizeof(Rooms) : sizeof(uint16_t));
+    }
+
+    void push_back(Time time, Client client, Rooms rooms)
+    {
+        if (m_size == m_capacity || !m_times.fits(time) || !m_rooms.fits(rooms))
+            reallocate(m_size == m_capacity ? std::max(MIN_CAPACITY, m_capacity * 2) : m_capacity,
+                       time, rooms);
+
+        auto pos       = slot(m_size);
+        m_clients[pos] = client;
+        m_times.set(pos, time);
+        m_rooms.set(pos, rooms);
+        ++m_size;
+    }
+
+    /**
+     * Insert the booking after all bookings with time <= `time`, the log must be ordered by time.
+     * Later bookings are shifted, so it's O(1) for in-order bookings and proportional to their
+     * count otherwise.
+     *
+     * @return index of the inserted booking
+     */
+    size_t insert_sorted(Time time, Client client, Rooms rooms)
+    {
+        auto idx = m_size;
+        while (idx > 0 && time < this->time(idx - 1))
+            --idx;
+
+        push_back(time, client, rooms);
+        if (idx + 1 == m_size)
+            return idx;
+
+        for (auto i = m_size - 1; i > idx; --i) {
+            auto to = slot(i), from = slot(i - 1);
+            m_clients[to] = m_clients[from];
+            m_times.move(to, from);
+            m_rooms.move(to, from);
+        }
+        auto pos       = slot(idx);
+        m_clients[pos] = client;
+        m_times.set(pos, time);
+        m_rooms.set(pos, rooms);
+        return idx;
+    }
+
+    /**
+     * Index of the booking of the client at the time, size() if there's none. The run of bookings
+     * with that time is found by binary search unless it's at the end, then it's scanned from
+     * its last booking: O(log n) plus the bookings at the time.
+     */
+    size_t find(Time time, Client client) const
+    {
+        if (!m_size || this->time(m_size - 1) < time)
+            return m_size;
+
+        auto end = this->time(m_size - 1) == time ? m_size : upper_bound(time);
+        for (auto idx = end; idx > 0 && this->time(idx - 1) == time;) {
+            --idx;
+            if (this->client(idx) == client)
+                return idx;
+        }
+        return m_size;
+    }
+
+    // Add rooms to the booking
+    void add_rooms(size_t idx, Rooms rooms)
+    {
+        auto value = Rooms(this->rooms(idx) + rooms);
+        if (!m_rooms.fits(value))
+            reallocate(m_capacity, time(idx), value);
+        m_rooms.set(slot(idx), value);
+    }
+
+    // Drop `count` oldest bookings
+    void pop_front(size_t count)
+    {
+        count   = std::min(count, m_size);
+        m_head  = (m_head + count) & mask();
+        m_size -= count;
+
+        if (m_size == 0) {
+            m_head = 0;
+        }
+
+        if (m_capacity > MIN_CAPACITY && m_size <= m_capacity / 4)
+            reallocate(std::max(MIN_CAPACITY, std::bit_ceil(m_size * 2)));
+        else if (m_size == 0 && (m_times.wide() || m_rooms.wide()))
+            reallocate(m_capacity);
+    }
+
+    void clear() { pop_front(m_size); }
+
+    // Index of the first booking with time greater than `tm`. Log must be ordered by time.
+    size_t upper_bound(Time tm) const
+    {
+        size_t first = 0;
+        size_t count = m_size;
+        while (count > 0) {
+            auto step = count / 2;
+            auto idx  = first + step;
+            if (!(tm < time(idx))) {
+                first  = idx + 1;
+                count -= step + 1;
+            } else {
+                count = step;
+            }
+        }
+        return first;
+    }
+
+    /**
+     * Visit clients and room counts of bookings [first, size()) as contiguous segments (at most
+     * two)
+     *
+     * @param f  callable with (std::span<const Client>, rooms span): room counts are the span
+     *           elements (Rooms or 16-bit offsets) plus rooms_base()
+     */
+    template<typename F>
+    void for_each_segment(size_t first, F&& f) const
+    {
+        for_each_range(first, [&](size_t start, size_t count) {
+            m_rooms.visit(start, count, [&](auto rooms) {
+                f(std::span<const Client>(&m_clients[start], count), rooms);
+            });
+        });
+    }
+
+    Rooms rooms_base() const { return m_rooms.base(); }
+
+    // Columns are saved as stored, packed ones included, so each one is loaded as one block
+    void save(snapshot_writer& out) const
+    {
+        auto live = [this](auto&& f) {
+            for_each_range(0, f);
+        };
+        out.value(uint64_t(m_size));
+        m_times.save(out, live);
+        for_each_range(0, [&](size_t start, size_t count) {
+            out.array_part(&m_clients[start], count);
+        });
+        out.pad();
+        m_rooms.save(out, live);
+    }
+
+    // Replaces the log content
+    bool load(snapshot_reader& in)
+    {
+        uint64_t size;
+        if (!in.value(size) || !in.fits(size, sizeof(uint32_t) + sizeof(Client) + sizeof(uint16_t)))
+            return false;
+
+        auto capacity = size ? std::max(MIN_CAPACITY, std::bit_ceil(size_t(size))) : size_t(0);
+        packed_column<Time, uint32_t>  times;
+        auto                           clients = pmr_array<Client>(m_memory, capacity);
+        packed_column<Rooms, uint16_t> rooms;
+        if (!times.load(in, m_memory, capacity, size) || !in.array(clients.get(), size) ||
+            !rooms.load(in, m_memory, capacity, size))
+            return false;
+
+        m_times    = std::move(times);
+        m_clients  = std::move(clients);
+        m_rooms    = std::move(rooms);
+        m_capacity = capacity;
+        m_head     = 0;
+        m_size     = size;
+        return true;
+    }
+
+private:
+    size_t mask() const { return m_capacity - 1; }
+    size_t slot(size_t idx) const { return (m_head + idx) & mask(); }
+
+    // Calls f(start, count) for the slot ranges of bookings [first, size())
+    template<typename F>
+    void for_each_range(size_t first, F&& f) const
+    {
+        if (first >= m_size)
+            return;
+
+        auto start = slot(first);
+        auto count = m_size - first;
+        auto part  = std::min(count, m_capacity - start);
+
+        f(start, part);
+        if (part < count)
+            f(size_t(0), count - part);
+    }
+
+    // Bounds of the live column values and `extra`
+    template<typename Column, typename Value>
+    std::pair<Value, Value> bounds(const Column& column, Value extra) const
+    {
+        Value lo = extra, hi = extra;
+        for_each_range(0, [&](size_t start, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                auto value = column.get(start + i);
+                lo         = std::min(lo, value);
+                hi         = std::max(hi, value);
+            }
+        });
+        return {lo, hi};
+    }
+
+    // Move bookings to a new storage, columns are repacked to fit the live values and the extra
+    // ones that are about to be added
+    void reallocate(size_t capacity, Time time, Rooms rooms)
+    {
+        auto live = [this](auto&& f) {
+            for_each_range(0, f);
+        };
+        auto [time_lo, time_hi]   = bounds(m_times, time);
+        auto [rooms_lo, rooms_hi] = bounds(m_rooms, rooms);
+        m_times.repack(m_memory, capacity, time_lo, time_hi, live);
+        m_rooms.repack(m_memory, capacity, rooms_lo, rooms_hi, live);
+
+        auto   clients = pmr_array<Client>(m_memory, capacity);
+        size_t copied  = 0;
+        for_each_range(0, [&](size_t start, size_t count) {
+            std::copy(&m_clients[start], &m_clients[start] + count, &clients[copied]);
+            copied += count;
+        });
+
+        m_clients  = std::move(clients);
+        m_capacity = capacity;
+        m_head     = 0;
+    }
+
+    void reallocate(size_t capacity)
+    {
+        if (m_size)
+            reallocate(capacity, time(0), rooms(0));
+        else
+            reallocate(capacity, m_times.base(), m_rooms.base());
+    }
+
+private:
+    std::pmr::memory_resource*     m_memory{std::pmr::get_default_resource()};
+    packed_column<Time, uint32_t>  m_times;
+    pmr_array<Client>              m_clients;
+    packed_column<Rooms, uint16_t> m_rooms;
+    size_t                         m_capacity{};
+    size_t                         m_head{};
+    size_t                         m_size{};
+};
+
+} // ::priv
+} // ::hotel_processing
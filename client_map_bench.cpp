@@ -0,0 +1,197 @@
+/**
+ *
+ * Client counters benchmark
+ *
+ * Replays gen.cpp workloads through the cached hotel model with two per-hotel client counter
+ * implementations: node-based std::unordered_map (the previous one) and priv::flat_map.
+ *
+ * Usage:
+ *    client_map_bench [INPUT_BLK...]
+ *
+ * Without arguments, workloads for several block sizes are generated in memory using the same
+ * scheme as gen.cpp does, so no worst-case files are required.
+ *
+ */
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fmt/format.h>
+
+#include "hotels.h"
+#include "parser.h"
+
+namespace dt = std::chrono;
+
+namespace {
+
+constexpr size_t MAX_REQ_COUNT = 100'000;
+constexpr size_t MAX_USER_ID   = 1'000'000'000;
+constexpr int    REPETITIONS   = 5;
+
+struct op
+{
+    hotel_processing::request_kind kind;
+    hotel_processing::hotel_id_t   hotel;
+    hotel_processing::time_t       time;
+    hotel_processing::client_id_t  client;
+};
+
+struct unordered_counter
+{
+    std::unordered_map<uint32_t, size_t> map;
+
+    void increment(uint32_t key) { ++map[key]; }
+
+    void decrement(uint32_t key)
+    {
+        auto it = map.find(key);
+        if (--it->second == 0)
+            map.erase(it);
+    }
+
+    size_t size() const { return map.size(); }
+};
+
+using flat_counter = hotel_processing::priv::flat_map;
+
+// Cached hotel model: log of bookings plus client counters
+template<typename Counter>
+struct hotel_model
+{
+    hotel_processing::priv::bookings_t bookings;
+    Counter                            clients;
+
+    void book(hotel_processing::time_t time, hotel_processing::client_id_t client)
+    {
+        clients.increment(client);
+        bookings.push_back(time, client, 1);
+    }
+
+    size_t query(hotel_processing::time_t current_time)
+    {
+        size_t count = 0;
+        for (; count < bookings.size(); ++count) {
+            if (bookings.time(count) > current_time - hotel_processing::TIME_WINDOW)
+                break;
+            clients.decrement(bookings.client(count));
+        }
+        bookings.pop_front(count);
+        return clients.size();
+    }
+};
+
+// Same data set as gen.cpp:generator() produces for the block size
+std::string generate(size_t block_size)
+{
+    std::default_random_engine                re(block_size);
+    std::uniform_int_distribution<size_t>     client_id(0, MAX_USER_ID);
+    const char*                               hotels[] = {"aaa", "bbb", "ccc", "ddd"};
+    size_t                                    idx      = 0;
+    auto                                      blocks   = MAX_REQ_COUNT / block_size;
+    size_t                                    book_time = 0;
+    std::string                               out = fmt::format("{}\n", blocks * block_size);
+
+    for (size_t i = 0; i < blocks; ++i) {
+        for (size_t j = 0; j < block_size - 2; ++j) {
+            book_time++;
+            out += fmt::format("BOOK {} {} {} 10\n", book_time, hotels[idx++ % std::size(hotels)],
+                               client_id(re));
+        }
+        book_time += 86400;
+        auto hotel = hotels[idx++ % std::size(hotels)];
+        out += fmt::format("BOOK {} {} {} 10\n", book_time, hotel, client_id(re));
+        out += fmt::format("{} {}\n", i % 2 ? "CLIENTS" : "ROOMS", hotel);
+    }
+
+    return out;
+}
+
+std::vector<op> load(std::string_view input, size_t& hotels_count)
+{
+    std::unordered_map<std::string_view, hotel_processing::hotel_id_t> ids;
+    std::vector<op>                                                    ops;
+    hotel_processing::request_parser                                   parser{input};
+    hotel_processing::request                                          req;
+    hotel_processing::time_t                                           current_time = 0;
+
+    auto count = parser.count();
+    ops.reserve(count);
+    for (size_t i = 0; i < count && parser.next(req); ++i) {
+        auto id = ids.try_emplace(req.hotel, hotel_processing::hotel_id_t(ids.size())).first->second;
+        if (req.kind == hotel_processing::request_kind::book)
+            current_time = req.time;
+        ops.push_back({req.kind, id, current_time, req.client});
+    }
+
+    hotels_count = ids.size();
+    return ops;
+}
+
+template<typename Counter>
+uint64_t replay(const std::vector<op>& ops, size_t hotels_count, size_t& checksum)
+{
+    uint64_t best = uint64_t(-1);
+
+    for (int rep = 0; rep < REPETITIONS; ++rep) {
+        std::vector<hotel_model<Counter>> hotels(hotels_count);
+        size_t                            sum = 0;
+
+        auto start = dt::steady_clock::now();
+        for (auto const& o : ops) {
+            if (o.kind == hotel_processing::request_kind::book)
+                hotels[o.hotel].book(o.time, o.client);
+            else
+                sum += hotels[o.hotel].query(o.time);
+        }
+        auto spent = dt::duration_cast<dt::microseconds>(dt::steady_clock::now() - start).count();
+
+        best     = std::min(best, uint64_t(spent));
+        checksum = sum;
+    }
+
+    return best;
+}
+
+void run(const std::string& name, std::string_view input)
+{
+    size_t hotels_count = 0;
+    auto   ops          = load(input, hotels_count);
+
+    size_t unordered_sum = 0;
+    size_t flat_sum      = 0;
+    auto   unordered_us  = replay<unordered_counter>(ops, hotels_count, unordered_sum);
+    auto   flat_us       = replay<flat_counter>(ops, hotels_count, flat_sum);
+
+    fmt::print("{:>20}: {:8d} ops, unordered_map {:8d} us ({:6.2f} Mops/s), flat_map {:8d} us "
+               "({:6.2f} Mops/s), x{:.2f}{}\n",
+               name, ops.size(), unordered_us, double(ops.size()) / std::max<uint64_t>(unordered_us, 1),
+               flat_us, double(ops.size()) / std::max<uint64_t>(flat_us, 1),
+               double(unordered_us) / std::max<uint64_t>(flat_us, 1),
+               unordered_sum == flat_sum ? "" : " MISMATCH");
+}
+
+} // ::anonymous
+
+int main(int argc, char* argv[])
+{
+    if (argc > 1) {
+        for (int i = 1; i < argc; ++i) {
+            hotel_processing::input_buffer input;
+            if (!input.open(argv[i])) {
+                fmt::print(stderr, "Can't read {}\n", argv[i]);
+                return 1;
+            }
+            run(argv[i], input.data());
+        }
+        return 0;
+    }
+
+    for (size_t block_size : {3, 10, 100, 1000, 10'000, 50'000, 100'000}) {
+        run(fmt::format("block {}", block_size), generate(block_size));
+    }
+
+    return 0;
+}
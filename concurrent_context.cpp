@@ -0,0 +1,136 @@
+#include "concurrent_context.h"
+
+namespace hotel_processing {
+
+concurrent_context::concurrent_context(std::vector<time_t> windows) :
+    m_windows(std::move(windows)),
+    m_chunks(std::make_unique<std::atomic<entry*>[]>(MAX_CHUNKS))
+{
+    if (m_windows.empty())
+        m_windows.push_back(TIME_WINDOW);
+}
+
+concurrent_context::~concurrent_context()
+{
+    for (size_t i = 0; i < MAX_CHUNKS; ++i)
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+}
+
+concurrent_context::entry& concurrent_context::at(hotel_id_t hotel) const
+{
+    auto chunk = m_chunks[hotel >> CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk[hotel & (CHUNK_SIZE - 1)];
+}
+
+hotel_id_t concurrent_context::intern(std::string_view hotel_name)
+{
+    if (auto id = find(hotel_name))
+        return *id;
+
+    std::unique_lock<std::shared_mutex> lock{m_directory_lock};
+    auto it = m_hotel_ids.find(hotel_name);
+    if (it != m_hotel_ids.end())
+        return it->second;
+
+    auto id = m_count.load(std::memory_order_relaxed);
+    if ((id >> CHUNK_BITS) >= MAX_CHUNKS)
+        return INVALID_HOTEL;
+    auto& chunk = m_chunks[id >> CHUNK_BITS];
+    if (!chunk.load(std::memory_order_relaxed))
+        chunk.store(new entry[CHUNK_SIZE], std::memory_order_release);
+
+    // Nobody sees the entry until the count is published
+    auto& info = at(id);
+    info.hotel.emplace(m_windows.size(), engine_options{}, std::pmr::new_delete_resource());
+    info.published.init(m_windows.size());
+
+    m_hotel_ids.emplace(hotel_name, id);
+    m_count.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+std::optional<hotel_id_t> concurrent_context::find(std::string_view hotel_name) const
+{
+    std::shared_lock<std::shared_mutex> lock{m_directory_lock};
+    auto it = m_hotel_ids.find(hotel_name);
+    if (it == m_hotel_ids.end())
+        return std::nullopt;
+    return it->second;
+}
+
+size_t concurrent_context::window_index(time_t window) const
+{
+    return std::find(m_windows.begin(), m_windows.end(), window) - m_windows.begin();
+}
+
+void concurrent_context::refresh(entry& info, time_t current_time)
+{
+    info.cleaned = std::max(info.cleaned, current_time);
+    info.hotel->remove_old(info.cleaned, m_windows);
+    info.published.publish(*info.hotel, m_windows.size());
+}
+
+void concurrent_context::book(time_t time, hotel_id_t hotel, client_id_t client_id,
+                              room_t room_count)
+{
+    if (hotel >= hotels_count())
+        return;
+
+    auto current = m_current_time.load(std::memory_order_relaxed);
+    while (current < time &&
+           !m_current_time.compare_exchange_weak(current, time, std::memory_order_acq_rel))
+        ;
+
+    auto&                       info = at(hotel);
+    std::lock_guard<std::mutex> lock{lock_of(hotel)};
+    info.hotel->insert({time, client_id, room_count}, info.cleaned, m_windows);
+    refresh(info, std::max(current, time));
+}
+
+void concurrent_context::book(time_t time, std::string_view hotel_name, client_id_t client_id,
+                              room_t room_count)
+{
+    book(time, intern(hotel_name), client_id, room_count);
+}
+
+std::pair<size_t, size_t> concurrent_context::read(hotel_id_t hotel, size_t window) const
+{
+    if (hotel >= hotels_count() || window >= m_windows.size())
+        return {0, 0};
+    return at(hotel).published.read(window);
+}
+
+size_t concurrent_context::clients(hotel_id_t hotel, time_t window) const
+{
+    return read(hotel, window_index(window)).first;
+}
+
+size_t concurrent_context::rooms(hotel_id_t hotel, time_t window) const
+{
+    return read(hotel, window_index(window)).second;
+}
+
+size_t concurrent_context::clients(std::string_view hotel_name) const
+{
+    auto hotel = find(hotel_name);
+    return hotel ? clients(*hotel) : 0;
+}
+
+size_t concurrent_context::rooms(std::string_view hotel_name) const
+{
+    auto hotel = find(hotel_name);
+    return hotel ? rooms(*hotel) : 0;
+}
+
+size_t concurrent_context::maintain()
+{
+    auto count   = hotels_count();
+    auto current = current_time();
+    for (hotel_id_t id = 0; id < count; ++id) {
+        std::lock_guard<std::mutex> lock{lock_of(id)};
+        refresh(at(id), current);
+    }
+    return count;
+}
+
+} // ::hotel_processing
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+#include "hotels.h"
+
+namespace hotel_processing {
+
+namespace priv {
+
+/**
+ * The published_aggregates class
+ *
+ * Hotel clients/rooms values for every window published with a seqlock: the writer (holding the
+ * hotel lock) bumps the sequence to odd, stores the values and bumps it to even again. Readers
+ * never block the writer, they retry if the sequence changed while they were reading.
+ */
+class published_aggregates
+{
+public:
+    void init(size_t windows)
+    {
+        m_values = std::make_unique<std::atomic<uint64_t>[]>(windows * 2);
+    }
+
+    template<typename Hotel>
+    void publish(const Hotel& hotel, size_t windows)
+    {
+        auto seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t w = 0; w < windows; ++w) {
+            m_values[w * 2].store(hotel.clients(w), std::memory_order_relaxed);
+            m_values[w * 2 + 1].store(hotel.rooms(w), std::memory_order_relaxed);
+        }
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Consistent {clients, rooms} pair of the window
+    std::pair<size_t, size_t> read(size_t window) const
+    {
+        for (;;) {
+            auto seq = m_seq.load(std::memory_order_acquire);
+            if (seq & 1)
+                continue;
+            auto clients = m_values[window * 2].load(std::memory_order_relaxed);
+            auto rooms   = m_values[window * 2 + 1].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_seq.load(std::memory_order_relaxed) == seq)
+                return {size_t(clients), size_t(rooms)};
+        }
+    }
+
+private:
+    std::atomic<uint64_t>                    m_seq{};
+    std::unique_ptr<std::atomic<uint64_t>[]> m_values;
+};
+
+} // ::priv
+
+/**
+ * The concurrent_context class
+ *
+ * Thread-safe context with exact (cached engine) aggregates:
+ *
+ *  - book() may be called from many threads: hotels are guarded by striped locks, so writers of
+ *    different hotels rarely contend. Bookings of a hotel are logged in time order whatever order
+ *    its writers get the lock in, so eviction stays exact.
+ *  - clients()/rooms() by hotel ID never lock: they read aggregates published by the last
+ *    book() or maintain() of the hotel. Eviction is off the read path: book() cleans up the
+ *    booked hotel, maintain() cleans up all of them and must be called periodically (e.g. by a
+ *    background thread); read values are as of the last clean up of the hotel.
+ *  - Hotels live in a chunked directory: chunks never move, so readers index it without locks.
+ *    Only name lookups and new hotel registration take the directory lock.
+ *
+ * Current time is the largest booked time.
+ */
+class concurrent_context
+{
+public:
+    /**
+     * @param windows  time windows to answer queries for, queries without window use the first
+     *                 one
+     */
+    explicit concurrent_context(std::vector<time_t> windows = {TIME_WINDOW});
+    ~concurrent_context();
+
+    concurrent_context(const concurrent_context&)            = delete;
+    concurrent_context& operator=(const concurrent_context&) = delete;
+
+    // Hotel ID for the name, new hotel is registered on first use
+    hotel_id_t intern(std::string_view hotel_name);
+
+    // Hotel ID lookup, never registers new hotels
+    std::optional<hotel_id_t> find(std::string_view hotel_name) const;
+
+    void book(time_t time, hotel_id_t hotel, client_id_t client_id, room_t room_count);
+    void book(time_t time, std::string_view hotel_name, client_id_t client_id, room_t room_count);
+
+    // Lock-free queries, unknown hotels and windows are answered with zero
+    size_t clients(hotel_id_t hotel) const { return read(hotel, 0).first; }
+    size_t rooms(hotel_id_t hotel) const { return read(hotel, 0).second; }
+    size_t clients(hotel_id_t hotel, time_t window) const;
+    size_t rooms(hotel_id_t hotel, time_t window) const;
+
+    // Name-based versions take the directory lock for the lookup
+    size_t clients(std::string_view hotel_name) const;
+    size_t rooms(std::string_view hotel_name) const;
+
+    /**
+     * Clean up all hotels at the current time and publish their aggregates
+     *
+     * @return hotels cleaned up
+     */
+    size_t maintain();
+
+    std::span<const time_t> windows() const { return m_windows; }
+
+    // Index of the window in windows(), windows().size() if it's not there
+    size_t window_index(time_t window) const;
+
+    time_t current_time() const { return m_current_time.load(std::memory_order_acquire); }
+
+    size_t hotels_count() const { return m_count.load(std::memory_order_acquire); }
+
+private:
+    using hotel_t = priv::hotel<priv::cached_engine>;
+
+    static constexpr size_t CHUNK_BITS = 10;
+    static constexpr size_t CHUNK_SIZE = size_t(1) << CHUNK_BITS;
+    static constexpr size_t MAX_CHUNKS = size_t(1) << 16;
+    static constexpr size_t STRIPES    = 64;
+
+    struct alignas(64) entry
+    {
+        std::optional<hotel_t>     hotel; // guarded by the stripe lock
+        // time of the last clean up, guarded by the stripe lock
+        time_t                     cleaned{std::numeric_limits<time_t>::min()};
+        priv::published_aggregates published;
+    };
+
+    struct alignas(64) stripe
+    {
+        std::mutex lock;
+    };
+
+    entry&      at(hotel_id_t hotel) const;
+    std::mutex& lock_of(hotel_id_t hotel) const { return m_stripes[hotel % STRIPES].lock; }
+
+    // Published {clients, rooms} of the window
+    std::pair<size_t, size_t> read(hotel_id_t hotel, size_t window) const;
+
+    // Clean up and publish, the hotel lock must be held
+    void refresh(entry& info, time_t current_time);
+
+private:
+    std::vector<time_t>                    m_windows;
+    std::atomic<time_t>                    m_current_time{};
+
+    // Directory: names and new chunks are guarded by m_directory_lock
+    mutable std::shared_mutex              m_directory_lock;
+    hotel_ids_map_t                        m_hotel_ids;
+    std::unique_ptr<std::atomic<entry*>[]> m_chunks;
+    std::atomic<hotel_id_t>                m_count{};
+
+    mutable std::array<stripe, STRIPES>    m_stripes;
+};
+
+} // ::hotel_processing
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "snapshot.h"
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The expiry_wheel class
+ *
+ * Context-wide expiry index. Time is divided into slots of 2^SLOT_BITS seconds; each slot keeps
+ * the hotels that got bookings in it, every hotel at most once per slot. When a slot is completely
+ * out of the window, its hotels are handed out for the cleanup in bounded incremental steps.
+ *
+ * Memory is proportional to the number of distinct (hotel, slot) pairs inside the window.
+ */
+template<typename Time, typename HotelId>
+class expiry_wheel
+{
+public:
+    static constexpr int  SLOT_BITS = 10;
+    static constexpr Time SLOT_MASK = (Time(1) << SLOT_BITS) - 1;
+
+    // Remember that the hotel got a booking at the time
+    void schedule(HotelId hotel, Time time)
+    {
+        auto index = time >> SLOT_BITS;
+
+        if (hotel >= m_last_slot.size())
+            m_last_slot.resize(hotel + 1, NO_SLOT);
+
+        // Time may go backwards: keep such hotel in the latest slot, it's checked a bit later
+        if (!m_slots.empty() && index < m_slots.back().index)
+            index = m_slots.back().index;
+
+        if (m_last_slot[hotel] == index)
+            return;
+        m_last_slot[hotel] = index;
+
+        if (m_slots.empty() || m_slots.back().index != index)
+            m_slots.push_back({index, {}});
+        m_slots.back().hotels.push_back(hotel);
+    }
+
+    /**
+     * Hand out hotels from the slots completely expired at `deadline`
+     *
+     * @param deadline   bookings with time <= deadline are expired
+     * @param max_hotels step limit
+     * @param f          callable with (HotelId)
+     * @return hotels handed out
+     */
+    template<typename F>
+    size_t expire(Time deadline, size_t max_hotels, F&& f)
+    {
+        size_t count = 0;
+        while (count < max_hotels && !m_slots.empty()) {
+            auto& front = m_slots.front();
+            if (((front.index << SLOT_BITS) | SLOT_MASK) > deadline)
+                break;
+
+            while (count < max_hotels && m_cursor < front.hotels.size()) {
+                auto hotel = front.hotels[m_cursor++];
+                if (m_last_slot[hotel] == front.index)
+                    m_last_slot[hotel] = NO_SLOT;
+                f(hotel);
+                ++count;
+            }
+
+            if (m_cursor == front.hotels.size()) {
+                m_slots.pop_front();
+                m_cursor = 0;
+            }
+        }
+        return count;
+    }
+
+    // Scheduled (hotel, slot) pairs
+    size_t pending() const
+    {
+        size_t count = 0;
+        for (auto const& slot : m_slots)
+            count += slot.hotels.size();
+        return count - m_cursor;
+    }
+
+    void save(snapshot_writer& out) const
+    {
+        out.value(uint64_t(m_slots.size()));
+        for (auto const& slot : m_slots) {
+            out.value(int64_t(slot.index));
+            out.value(uint64_t(slot.hotels.size()));
+            out.array(slot.hotels.data(), slot.hotels.size());
+        }
+        out.value(uint64_t(m_cursor));
+        out.value(uint64_t(m_last_slot.size()));
+        out.array(m_last_slot.data(), m_last_slot.size());
+    }
+
+    // Replaces the state, scheduled hotels must be less than `hotels`
+    bool load(snapshot_reader& in, size_t hotels)
+    {
+        uint64_t slots, cursor, last_slots;
+        if (!in.value(slots))
+            return false;
+
+        m_slots.clear();
+        for (uint64_t i = 0; i < slots; ++i) {
+            int64_t  index;
+            uint64_t count;
+            if (!in.value(index) || !in.value(count) || count > hotels ||
+                !in.fits(count, sizeof(HotelId)))
+                return false;
+            auto& slot = m_slots.emplace_back(Time(index), std::vector<HotelId>(count));
+            if (!in.array(slot.hotels.data(), count))
+                return false;
+            for (auto hotel : slot.hotels) {
+                if (hotel >= hotels)
+                    return false;
+            }
+        }
+
+        if (!in.value(cursor) || !in.value(last_slots) || last_slots > hotels ||
+            !in.fits(last_slots, sizeof(m_last_slot[0])) ||
+            (m_slots.empty() ? cursor != 0 : cursor >= m_slots.front().hotels.size()))
+            return false;
+        m_cursor = cursor;
+        m_last_slot.resize(last_slots);
+        return in.array(m_last_slot.data(), last_slots);
+    }
+
+private:
+    static constexpr Time NO_SLOT = Time(1) << (sizeof(Time) * 8 - 2);
+
+    struct slot
+    {
+        Time                 index;
+        std::vector<HotelId> hotels;
+    };
+
+    std::deque<slot>  m_slots;
+    size_t            m_cursor{}; // position in the front slot
+    std::vector<Time> m_last_slot; // per hotel
+};
+
+} // ::priv
+} // ::hotel_processing
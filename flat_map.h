@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <memory>
+
+#include "memory.h"
+#include "snapshot.h"
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The flat_map class
+ *
+ * Open-addressing hash map from uint32_t keys to uint32_t values with linear probing and
+ * backward-shift deletion: no tombstones and no per-entry allocations. Zero value marks an empty
+ * slot, so zero can't be stored as a value; it's natural for reference counters.
+ */
+class flat_map
+{
+public:
+    static constexpr size_t MIN_CAPACITY = 16;
+    // Tables up to this size are never shrunk: rehashing costs more than the memory is worth
+    static constexpr size_t KEEP_CAPACITY = 1024;
+
+    flat_map() = default;
+    explicit flat_map(std::pmr::memory_resource* memory) : m_memory(memory) {}
+
+    size_t size() const { return m_size; }
+    bool   empty() const { return m_size == 0; }
+    size_t capacity() const { return m_capacity; }
+
+    // Value for the key, 0 if absent
+    uint32_t find(uint32_t key) const
+    {
+        if (!m_size)
+            return 0;
+        for (auto idx = home(key);; idx = next(idx)) {
+            auto const& slot = m_slots[idx];
+            if (!slot.value)
+                return 0;
+            if (slot.key == key)
+                return slot.value;
+        }
+    }
+
+    // Increase counter for the key, returns new value
+    uint32_t increment(uint32_t key)
+    {
+        if ((m_size + 1) * 4 > m_capacity * 3)
+            rehash(m_capacity ? m_capacity * 2 : MIN_CAPACITY);
+
+        auto idx = home(key);
+        for (; m_slots[idx].value; idx = next(idx)) {
+            if (m_slots[idx].key == key)
+                return ++m_slots[idx].value;
+        }
+
+        m_slots[idx] = {key, 1};
+        ++m_size;
+        return 1;
+    }
+
+    // Decrease counter for the key, the key is erased when counter reaches zero. Key must exist.
+    uint32_t decrement(uint32_t key)
+    {
+        auto idx   = locate(key);
+        auto value = --m_slots[idx].value;
+        if (!value)
+            erase_slot(idx);
+        return value;
+    }
+
+    // Store non-zero value for the key
+    void set(uint32_t key, uint32_t value)
+    {
+        if ((m_size + 1) * 4 > m_capacity * 3)
+            rehash(m_capacity ? m_capacity * 2 : MIN_CAPACITY);
+
+        auto idx = home(key);
+        for (; m_slots[idx].value; idx = next(idx)) {
+            if (m_slots[idx].key == key) {
+                m_slots[idx].value = value;
+                return;
+            }
+        }
+
+        m_slots[idx] = {key, value};
+        ++m_size;
+    }
+
+    void erase(uint32_t key)
+    {
+        if (!m_size)
+            return;
+        for (auto idx = home(key); m_slots[idx].value; idx = next(idx)) {
+            if (m_slots[idx].key == key) {
+                erase_slot(idx);
+                return;
+            }
+        }
+    }
+
+    void clear()
+    {
+        m_slots.reset();
+        m_capacity = 0;
+        m_size     = 0;
+        m_shift    = 64;
+    }
+
+    template<typename F>
+    void for_each(F&& f) const
+    {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            if (m_slots[i].value)
+                f(m_slots[i].key, m_slots[i].value);
+        }
+    }
+
+    // Table is saved as is, loading needs no rehashing
+    void save(snapshot_writer& out) const
+    {
+        out.value(uint64_t(m_capacity));
+        out.value(uint64_t(m_size));
+        out.array(m_slots.get(), m_capacity);
+    }
+
+    bool load(snapshot_reader& in)
+    {
+        uint64_t capacity, size;
+        if (!in.value(capacity) || !in.value(size) || !in.fits(capacity, sizeof(slot)))
+            return false;
+
+        clear();
+        if (!capacity)
+            return !size;
+        if (capacity < MIN_CAPACITY || !std::has_single_bit(capacity))
+            return false;
+        rehash(capacity);
+        if (!in.array(m_slots.get(), capacity))
+            return false;
+
+        for (size_t i = 0; i < capacity; ++i)
+            m_size += m_slots[i].value != 0;
+        return m_size == size;
+    }
+
+private:
+    struct slot
+    {
+        uint32_t key;
+        uint32_t value;
+    };
+
+    // Fibonacci hashing: top bits of the product are well mixed
+    size_t home(uint32_t key) const { return size_t((key * 0x9E3779B97F4A7C15ull) >> m_shift); }
+    size_t next(size_t idx) const { return (idx + 1) & (m_capacity - 1); }
+
+    size_t locate(uint32_t key) const
+    {
+        auto idx = home(key);
+        while (m_slots[idx].key != key || !m_slots[idx].value)
+            idx = next(idx);
+        return idx;
+    }
+
+    void erase_slot(size_t hole)
+    {
+        // Shift following entries back while it brings them closer to their home slots
+        for (auto idx = next(hole); m_slots[idx].value; idx = next(idx)) {
+            auto desired = home(m_slots[idx].key);
+            if (((idx - desired) & (m_capacity - 1)) >= ((idx - hole) & (m_capacity - 1))) {
+                m_slots[hole] = m_slots[idx];
+                hole          = idx;
+            }
+        }
+        m_slots[hole].value = 0;
+        --m_size;
+
+        if (m_capacity > KEEP_CAPACITY && m_size * 8 < m_capacity)
+            rehash(m_capacity / 2);
+    }
+
+    void rehash(size_t capacity)
+    {
+        auto slots    = std::move(m_slots);
+        auto old_size = m_capacity;
+
+        m_slots = pmr_array<slot>(m_memory, capacity);
+        std::fill_n(m_slots.get(), capacity, slot{});
+        m_capacity = capacity;
+        m_shift    = 64 - std::countr_zero(capacity);
+
+        for (size_t i = 0; i < old_size; ++i) {
+            if (!slots[i].value)
+                continue;
+            auto idx = home(slots[i].key);
+            while (m_slots[idx].value)
+                idx = next(idx);
+            m_slots[idx] = slots[i];
+        }
+    }
+
+private:
+    std::pmr::memory_resource* m_memory{std::pmr::get_default_resource()};
+    pmr_array<slot>            m_slots;
+    size_t                     m_capacity{};
+    size_t                     m_size{};
+    int                        m_shift{64};
+};
+
+} // ::priv
+} // ::hotel_processing
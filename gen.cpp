@@ -2,8 +2,10 @@
  *
  * Load generator
  *
- * Uses file system to generate test input and parse it.
- * Do it in parallel using all existing CPU cores (minus 1: for logger thread).
+ * Generates test input in memory, parses it into requests and processes them, every step is timed
+ * separately. Only the slowest inputs are written to files.
+ * Do it in parallel using all existing CPU cores (minus 1: for logger thread), block sizes are
+ * handed out to work-stealing workers, the most expensive ones first.
  *
  * Idea:
  *
@@ -30,211 +32,326 @@
 #include <iostream>
 #include <random>
 #include <chrono>
-#include <filesystem>
+#include <algorithm>
+#include <atomic>
 #include <thread>
-#include <future>
+#include <mutex>
+#include <deque>
 #include <vector>
 #include <fmt/format.h>
 
+#include "batcher.h"
 #include "hotels.h"
+#include "parser.h"
 
 static constexpr size_t MAX_REQ_COUNT = 100'000;
 static constexpr size_t MAX_USER_ID   = 1'000'000'000;
+// Inputs parsed and processed at least that long are saved
+static constexpr uint64_t WRITE_THRESHOLD_MS = 350;
 
 namespace dt = std::chrono;
-namespace fs = std::filesystem;
 
 /**
- * The locked_queue struct
+ * The block_timing struct
  *
- * simple structure to communicate between workers and logger thread
+ * Milliseconds spent for each step of the block size run
  */
-struct locked_queue
+struct block_timing
 {
-    std::mutex m;
-    std::condition_variable cv;
-    std::deque<std::tuple<size_t, uint64_t>> q;
-
-    void push(size_t block_size, uint64_t spent_time)
-    {
-        std::unique_lock<std::mutex> lock{m};
-        q.emplace_back(block_size, spent_time);
-        lock.unlock();
-        cv.notify_one();
-    }
-
-    void pop(size_t &block_size, uint64_t &spent_time)
-    {
-        std::unique_lock<std::mutex> lock{m};
-        if (q.empty()) {
-            cv.wait(lock, [this]{
-                return !q.empty();
-            });
-        }
-        block_size = std::get<0>(q.front());
-        spent_time = std::get<1>(q.front());
-        q.pop_front();
-    }
+    size_t   block_size;
+    uint64_t generate;
+    uint64_t parse;
+    uint64_t process;
 };
 
 /**
- * process input file
+ * The mpsc_channel class
  *
- * Just a copy of the main.cpp:main() proc oriented to work with file streams instead of
- * std::cin.
- *
- * @param fn   file to process
- * @return time spent for processing, uint64_t(-1) on failure
+ * Lock-free unbounded multi-producer single-consumer queue (intrusive list with a stub node):
+ * producers swap the head and link the previous node, the consumer follows the links from the
+ * tail. The consumer sleeps on the count of pushed items, so an idle logger costs nothing.
  */
-static uint64_t process(const fs::path& fn)
+template<typename T>
+class mpsc_channel
 {
-    auto start = dt::steady_clock::now();
+public:
+    mpsc_channel() : m_head(new node{}), m_tail(m_head.load()) {}
 
-    std::ifstream ifs(fn);
-    if (!ifs)
-        return -1;
+    ~mpsc_channel()
+    {
+        while (m_tail) {
+            auto next = m_tail->next.load(std::memory_order_relaxed);
+            delete m_tail;
+            m_tail = next;
+        }
+    }
 
-    hotel_processing::context ctx;
+    mpsc_channel(const mpsc_channel&)            = delete;
+    mpsc_channel& operator=(const mpsc_channel&) = delete;
 
-    size_t requests_count;
-    ifs >> requests_count;
+    // Any thread
+    void push(T value)
+    {
+        auto item = new node{std::move(value)};
+        auto prev = m_head.exchange(item, std::memory_order_acq_rel);
+        prev->next.store(item, std::memory_order_release);
+        m_count.fetch_add(1, std::memory_order_release);
+        m_count.notify_one();
+    }
 
-    for (size_t i = 0; i < requests_count; ++i) {
-        std::string request_kind;
-        ifs >> request_kind;
+    // Consumer thread only, blocks until there's an item
+    T pop()
+    {
+        m_count.wait(0, std::memory_order_acquire);
+        node* next;
+        // The item is counted, but its producer may be between exchange and link yet
+        while (!(next = m_tail->next.load(std::memory_order_acquire)))
+            std::this_thread::yield();
+        m_count.fetch_sub(1, std::memory_order_relaxed);
+
+        auto value = std::move(next->value);
+        delete m_tail;
+        m_tail = next;
+        return value;
+    }
 
-        if (request_kind == "BOOK") {
-            hotel_processing::time_t time;
-            hotel_processing::client_id_t client;
-            hotel_processing::room_t rooms;
-            std::string hotel_name;
+private:
+    struct node
+    {
+        T                  value{};
+        std::atomic<node*> next{};
+    };
 
-            ifs >> time >> hotel_name >> client >> rooms;
+    std::atomic<node*>  m_head;
+    node*               m_tail;
+    std::atomic<size_t> m_count{};
+};
 
-            ctx.book(time, hotel_name, client, rooms);
+/**
+ * Run fn(worker, task) for every task on `threads` work-stealing workers
+ *
+ * Tasks are dealt round-robin in the given order, so when they are sorted by decreasing cost,
+ * every worker starts from its most expensive ones. A worker out of tasks steals the cheapest
+ * task of another worker, the run ends when there's nothing left to steal.
+ */
+template<typename Task, typename Fn>
+void run_work_stealing(const std::vector<Task>& tasks, unsigned threads, Fn&& fn)
+{
+    struct alignas(64) worker_queue
+    {
+        std::mutex       lock;
+        std::deque<Task> tasks;
+    };
 
-        } else {
-            std::string hotel_name;
-            ifs >> hotel_name;
+    std::vector<worker_queue> queues(threads);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        queues[i % threads].tasks.push_back(tasks[i]);
+    }
 
-            if (request_kind == "CLIENTS") {
-                ctx.clients(hotel_name);
-                //std::cout << ctx.clients(hotel_name) << '\n';
-            } else if (request_kind == "ROOMS") {
-                ctx.rooms(hotel_name);
-                //std::cout << ctx.rooms(hotel_name) << '\n';
+    auto take = [&](unsigned worker, Task& task) {
+        for (unsigned i = 0; i < threads; ++i) {
+            auto& queue = queues[(worker + i) % threads];
+            std::lock_guard<std::mutex> lock{queue.lock};
+            if (queue.tasks.empty())
+                continue;
+            // own tasks from the front, stolen ones from the back
+            if (i == 0) {
+                task = queue.tasks.front();
+                queue.tasks.pop_front();
+            } else {
+                task = queue.tasks.back();
+                queue.tasks.pop_back();
             }
+            return true;
         }
-
+        return false;
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned worker = 0; worker < threads; ++worker) {
+        workers.emplace_back([&, worker] {
+            Task task;
+            while (take(worker, task))
+                fn(worker, task);
+        });
     }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+}
 
-    return dt::duration_cast<dt::milliseconds>(dt::steady_clock::now() - start).count();
+static uint64_t elapsed_ms(dt::steady_clock::time_point start)
+{
+    return uint64_t(dt::duration_cast<dt::milliseconds>(dt::steady_clock::now() - start).count());
 }
 
 /**
- * generator   A data generator.
- *
- * After data set completing, call process step.
+ * generate input for the block size
  *
- * @param queue
- * @param block_start
- * @param block_step
- * @return
+ * @param out  requests in the main.cpp format
  */
-int generator(locked_queue *queue, size_t block_start, size_t block_step)
+template<typename Random>
+static void generate(fmt::memory_buffer& out, size_t block_size, Random& re)
 {
-    std::random_device rnd;
-    std::default_random_engine re(rnd());
     std::uniform_int_distribution<size_t> client_id(0, MAX_USER_ID);
 
-        const char *hotels[] = {
-            "aaa",
-            "bbb",
-            "ccc",
-            "ddd",
-            };
-    size_t idx = 0;
-
-    for (size_t block_size = block_start; block_size <= MAX_REQ_COUNT; block_size += block_step) {
-        auto fn_formatted = fs::path(fmt::format("INPUT_BLK{:06d}", block_size));
-        auto fn = fs::path(fmt::format("INPUT_BLK_TMP{}", block_start));
-        auto blocks = MAX_REQ_COUNT / block_size;
-        auto total = blocks * block_size;
-        size_t book_time = 0;
-
-        std::ofstream ofs{fn};
-        if (!ofs)
-            return 1;
-
-        ofs << total << '\n';
-        for (size_t i = 0; i < blocks; ++i) {
-            for (size_t j = 0; j < block_size - 2; ++j) {
-                book_time++;
-                auto user_id = client_id(re);
-                auto hotel = hotels[idx++ % std::size(hotels)];
-
-                ofs << "BOOK " << book_time << " " << hotel << " " << user_id << " 10\n";
-            }
-            book_time += 86400;
-            auto user_id = client_id(re);
+    static const char *hotels[] = {
+        "aaa",
+        "bbb",
+        "ccc",
+        "ddd",
+    };
+
+    auto   blocks    = MAX_REQ_COUNT / block_size;
+    auto   total     = blocks * block_size;
+    auto   inserter  = std::back_inserter(out);
+    size_t book_time = 0;
+    size_t idx       = 0;
+
+    out.clear();
+    fmt::format_to(inserter, "{}\n", total);
+    for (size_t i = 0; i < blocks; ++i) {
+        for (size_t j = 0; j < block_size - 2; ++j) {
+            book_time++;
             auto hotel = hotels[idx++ % std::size(hotels)];
-            ofs << "BOOK " << book_time << " " << hotel << " " << user_id << " 10\n";
-
-            if (i % 2) {
-                ofs << "CLIENTS " << hotel << '\n';
-            } else {
-                ofs << "ROOMS " << hotel << '\n';
-            }
+            fmt::format_to(inserter, "BOOK {} {} {} 10\n", book_time, hotel, client_id(re));
         }
-        ofs.close();
+        book_time += 86400;
+        auto hotel = hotels[idx++ % std::size(hotels)];
+        fmt::format_to(inserter, "BOOK {} {} {} 10\n", book_time, hotel, client_id(re));
+        fmt::format_to(inserter, "{} {}\n", i % 2 ? "CLIENTS" : "ROOMS", hotel);
+    }
+}
 
-        auto spent_time = process(fn);
-        queue->push(block_size, spent_time);
-        if (spent_time >= 350) {
-            fs::copy_file(fn, fn_formatted, fs::copy_options::overwrite_existing);
-        }
+/**
+ * parse input into the typed request stream
+ *
+ * Same parser as main.cpp uses, requests point into the input.
+ */
+static void parse(std::string_view input, std::vector<hotel_processing::request>& requests)
+{
+    hotel_processing::request_parser parser{input};
+    hotel_processing::request        req;
+
+    size_t requests_count = parser.count();
+
+    requests.clear();
+    requests.reserve(requests_count);
+    for (size_t i = 0; i < requests_count && parser.next(req); ++i) {
+        requests.push_back(req);
     }
+}
+
+/**
+ * process requests
+ *
+ * Runs the same processing path as main.cpp:process(): requests go through request_batcher to
+ * book_batch()/query_batch(), answers are dropped.
+ */
+static void process(const std::vector<hotel_processing::request>& requests)
+{
+    hotel_processing::context         ctx;
+    hotel_processing::request_batcher batch{ctx, [](std::span<const size_t>) {}};
 
-    return 0;
+    for (auto const& req : requests)
+        batch.add(req);
 }
 
-int main()
+// Requests in the block size input, parsing and processing time is about proportional to it
+static size_t block_cost(size_t block_size)
 {
-    locked_queue queue;
-    std::vector<std::future<int>> workers;
-    auto pool_size = std::thread::hardware_concurrency() - 1;
+    return MAX_REQ_COUNT / block_size * block_size;
+}
 
-    workers.reserve(pool_size);
+/**
+ * The generator class
+ *
+ * Per worker state: random engine and buffers reused between block sizes.
+ */
+class generator
+{
+public:
+    generator() : m_re(std::random_device{}()) {}
+
+    /**
+     * Generate the block size input in memory, parse and process it. Input is written to
+     * INPUT_BLKnnnnnn file if parsing and processing take at least WRITE_THRESHOLD_MS.
+     *
+     * @return false if the input file can't be written
+     */
+    bool run(size_t block_size, mpsc_channel<block_timing>& results)
+    {
+        block_timing timing{block_size, 0, 0, 0};
+
+        auto start = dt::steady_clock::now();
+        generate(m_text, block_size, m_re);
+        timing.generate = elapsed_ms(start);
+
+        std::string_view input{m_text.data(), m_text.size()};
+        start = dt::steady_clock::now();
+        parse(input, m_requests);
+        timing.parse = elapsed_ms(start);
+
+        start = dt::steady_clock::now();
+        process(m_requests);
+        timing.process = elapsed_ms(start);
+
+        results.push(timing);
+        if (timing.parse + timing.process >= WRITE_THRESHOLD_MS) {
+            std::ofstream ofs{fmt::format("INPUT_BLK{:06d}", block_size), std::ios::binary};
+            ofs.write(input.data(), std::streamsize(input.size()));
+            return bool(ofs);
+        }
+        return true;
+    }
+
+private:
+    std::default_random_engine             m_re;
+    fmt::memory_buffer                     m_text;
+    std::vector<hotel_processing::request> m_requests;
+};
+
+int main()
+{
+    mpsc_channel<block_timing> results;
+    auto pool_size = std::max(std::thread::hardware_concurrency(), 2u) - 1;
 
     // Synchronize logging in one place
-    auto logger = std::thread([&queue]() {
+    auto logger = std::thread([&results]() {
         uint64_t max_spent_time = 0;
         while (true) {
-            size_t block_size;
-            uint64_t spent_time;
-
-            queue.pop(block_size, spent_time);
-            if (!block_size)
+            auto timing = results.pop();
+            if (!timing.block_size)
                 break;
 
+            auto spent_time = timing.parse + timing.process;
             if (spent_time > max_spent_time)
                 max_spent_time = spent_time;
 
-            fmt::print("{:06d}: {:6d} {}\n", block_size, max_spent_time, spent_time);
+            fmt::print("{:06d}: {:6d} {} (generate {}, parse {}, process {})\n", timing.block_size,
+                       max_spent_time, spent_time, timing.generate, timing.parse, timing.process);
         }
     });
 
-    for (size_t i = 0; i < pool_size; ++i) {
-        workers.push_back(std::async(std::launch::async, generator, &queue, 3 + i, pool_size));
+    // Largest cost first, equal costs by block size
+    std::vector<size_t> block_sizes;
+    for (size_t block_size = 3; block_size <= MAX_REQ_COUNT; ++block_size) {
+        block_sizes.push_back(block_size);
     }
+    std::stable_sort(block_sizes.begin(), block_sizes.end(), [](size_t a, size_t b) {
+        return block_cost(a) > block_cost(b);
+    });
 
-    int ret = 0;
-    for (auto &f : workers) {
-        ret += f.get();
-    }
+    std::vector<generator> generators(pool_size);
+    std::atomic<int>       failures{};
+    run_work_stealing(block_sizes, pool_size, [&](unsigned worker, size_t block_size) {
+        if (!generators[worker].run(block_size, results))
+            failures.fetch_add(1, std::memory_order_relaxed);
+    });
 
-    queue.push(0, 0);
+    results.push({0, 0, 0, 0});
     logger.join();
 
-    return ret;
+    return failures.load();
 }
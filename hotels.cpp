@@ -1,117 +1,755 @@
+#include <cstring>
+#include <fstream>
+#include <limits>
+
 #include "hotels.h"
+#include "parser.h"
 
 namespace hotel_processing {
 
-void context::book(time_t time, const std::string &hotel_name, client_id_t client_id, room_t room_count)
+namespace priv {
+
+template<typename Engine>
+size_t hotel<Engine>::remove_old(time_t current_time, std::span<const time_t> windows)
 {
-    m_current_time = time;
-    m_hotels[hotel_name].book({time, client_id, room_count});
+    m_state.cleaned(current_time, windows);
+
+    if (m_bookings.empty()) {
+        return 0;
+    }
+
+    // The largest window has the smallest position of the first booking
+    size_t count = m_bookings.size();
+    for (size_t w = 0; w < windows.size(); ++w) {
+        auto  deadline = current_time - windows[w];
+        auto& first    = m_first[w];
+        if constexpr (Engine::EVICT_SCAN) {
+            for (; first < m_bookings.size(); ++first) {
+                if (m_bookings.time(first) > deadline) {
+                    break;
+                }
+                m_state.evict(w, m_bookings.time(first), m_bookings.client(first),
+                              m_bookings.rooms(first));
+            }
+        } else {
+            first = std::max(first, m_bookings.upper_bound(deadline));
+        }
+        count = std::min(count, first);
+    }
+
+    if (count) {
+        m_bookings.pop_front(count);
+        for (auto& first : m_first)
+            first -= count;
+    }
+    return count;
 }
 
-size_t context::clients(const std::string &hotel_name)
+template<typename Engine>
+void hotel<Engine>::save(snapshot_writer& out) const
 {
-    return m_hotels[hotel_name].clients(m_current_time);
+    m_bookings.save(out);
+    out.array(m_first.data(), m_first.size());
+    m_state.save(out);
 }
 
-size_t context::rooms(const std::string &hotel_name)
+template<typename Engine>
+bool hotel<Engine>::load(snapshot_reader& in)
 {
-    return m_hotels[hotel_name].rooms(m_current_time);
+    if (!m_bookings.load(in) || !in.array(m_first.data(), m_first.size()))
+        return false;
+    for (auto first : m_first) {
+        if (first > m_bookings.size())
+            return false;
+    }
+    return m_state.load(in);
 }
 
-namespace priv {
+cached_engine::hotel_state::hotel_state(size_t windows, const engine_options&,
+                                        std::pmr::memory_resource* memory) :
+    m_windows(memory)
+{
+    m_windows.reserve(windows);
+    for (size_t w = 0; w < windows; ++w)
+        m_windows.push_back({flat_map{memory}, 0});
+}
 
-#ifdef CACHED
-void hotel::book(booking &&info)
+void cached_engine::hotel_state::book(const booking& info)
 {
-    setup(info.rooms, info.client);
-    m_bookings.push_back(std::move(info));
+    for (auto& window : m_windows) {
+        window.rooms += info.rooms;
+        window.client_bookings.increment(info.client);
+    }
 }
 
-size_t hotel::clients(time_t current_time)
+void cached_engine::hotel_state::merge(const booking& info)
 {
-    remove_old(current_time);
-    return m_client_bookings.size();
+    for (auto& window : m_windows)
+        window.rooms += info.rooms;
 }
 
-size_t hotel::rooms(time_t current_time)
+void cached_engine::hotel_state::evict(size_t window, time_t, client_id_t client, room_t rooms)
 {
-    remove_old(current_time);
-    return m_rooms;
+    m_windows[window].rooms -= rooms;
+    m_windows[window].client_bookings.decrement(client);
 }
 
-void hotel::setup(room_t rooms, client_id_t client)
+size_t cached_engine::hotel_state::tracked_clients() const
 {
-    m_rooms += rooms;
-    ++m_client_bookings[client];
+    size_t count = 0;
+    for (auto const& window : m_windows)
+        count = std::max(count, window.client_bookings.size());
+    return count;
 }
 
-void hotel::cleanup(room_t rooms, client_id_t client)
+void cached_engine::hotel_state::save(snapshot_writer& out) const
 {
-    m_rooms -= rooms;
-    auto client_it = m_client_bookings.find(client);
-    if (--client_it->second == 0) {
-        m_client_bookings.erase(client_it);
+    for (auto const& window : m_windows) {
+        out.value(uint64_t(window.rooms));
+        window.client_bookings.save(out);
     }
 }
 
-void hotel::remove_old(time_t current_time)
+bool cached_engine::hotel_state::load(snapshot_reader& in)
 {
-    if (m_bookings.empty()) {
-        return;
+    for (auto& window : m_windows) {
+        uint64_t rooms;
+        if (!in.value(rooms) || !window.client_bookings.load(in))
+            return false;
+        window.rooms = size_t(rooms);
     }
+    return true;
+}
 
-    auto it = m_bookings.begin();
-    for (; it != m_bookings.end(); ++it) {
-        if (it->time > (current_time - TIME_WINDOW)) {
-            break;
-        }
-        cleanup(it->rooms, it->client);
+size_t lazy_engine::hotel_state::clients(size_t, const bookings_t& bookings, size_t first) const
+{
+    std::vector<client_id_t> tmp;
+    tmp.reserve(bookings.size() - first);
+    bookings.for_each_segment(first, [&tmp](auto clients, auto) {
+        tmp.insert(tmp.end(), clients.begin(), clients.end());
+    });
+    std::sort(tmp.begin(), tmp.end());
+    auto last = std::unique(tmp.begin(), tmp.end());
+    return std::distance(tmp.begin(), last);
+}
+
+size_t lazy_engine::hotel_state::rooms(size_t, const bookings_t& bookings, size_t first) const
+{
+    size_t sum = 0;
+    bookings.for_each_segment(first, [&sum](auto, auto rooms) {
+        sum = std::accumulate(rooms.begin(), rooms.end(), sum);
+    });
+    return sum + bookings.rooms_base() * (bookings.size() - first);
+}
+
+approx_engine::hotel_state::hotel_state(size_t windows, const engine_options& options,
+                                        std::pmr::memory_resource* memory) :
+    m_estimator(sliding_hll<time_t>::precision_for(options.clients_error), memory),
+    // Nothing is out of the windows until the first clean up
+    m_since(windows, std::numeric_limits<time_t>::min(), memory),
+    m_rooms(windows, memory)
+{
+}
+
+void approx_engine::hotel_state::book(const booking& info)
+{
+    m_estimator.add(info.client, info.time);
+    for (auto& rooms : m_rooms)
+        rooms += info.rooms;
+}
+
+void approx_engine::hotel_state::merge(const booking& info)
+{
+    for (auto& rooms : m_rooms)
+        rooms += info.rooms;
+}
+
+void approx_engine::hotel_state::cleaned(time_t current_time, std::span<const time_t> windows)
+{
+    for (size_t w = 0; w < windows.size(); ++w)
+        m_since[w] = current_time - windows[w];
+}
+
+void approx_engine::hotel_state::save(snapshot_writer& out) const
+{
+    m_estimator.save(out);
+    out.array(m_since.data(), m_since.size());
+    out.array(m_rooms.data(), m_rooms.size());
+}
+
+bool approx_engine::hotel_state::load(snapshot_reader& in)
+{
+    return m_estimator.load(in) && in.array(m_since.data(), m_since.size()) &&
+           in.array(m_rooms.data(), m_rooms.size());
+}
+
+template struct hotel<cached_engine>;
+template struct hotel<lazy_engine>;
+template struct hotel<approx_engine>;
+
+} // ::priv
+
+template<typename Engine>
+basic_context<Engine>::basic_context(std::vector<time_t> windows, engine_options options,
+                                     memory_options memory) :
+    m_windows(std::move(windows)),
+    m_options(options),
+    m_memory(memory)
+{
+    if (m_windows.empty())
+        m_windows.push_back(TIME_WINDOW);
+    m_max_window = *std::max_element(m_windows.begin(), m_windows.end());
+
+    // Late bookings must stay inside every window, see hotel::insert()
+    auto min_window   = *std::min_element(m_windows.begin(), m_windows.end());
+    m_options.reorder = std::clamp<time_t>(m_options.reorder, 0, min_window - 1);
+
+    if constexpr (Engine::AGGREGATES)
+        m_ranks.resize(m_windows.size());
+}
+
+template<typename Engine>
+hotel_id_t basic_context<Engine>::intern(std::string_view hotel_name)
+{
+    auto it = m_hotel_ids.find(hotel_name);
+    if (it != m_hotel_ids.end())
+        return it->second;
+
+    auto id = hotel_id_t(m_hotels.size());
+    m_hotels.emplace_back(m_windows.size(), m_options, m_memory.resource());
+    if (m_options.history > 0)
+        m_history.emplace_back(m_memory.resource());
+    m_names.push_back(m_hotel_ids.emplace(hotel_name, id).first->first);
+    if constexpr (STATS_ENABLED)
+        m_stats.hotels.emplace_back();
+    return id;
+}
+
+template<typename Engine>
+std::optional<hotel_id_t> basic_context<Engine>::find(std::string_view hotel_name) const
+{
+    auto it = m_hotel_ids.find(hotel_name);
+    if (it == m_hotel_ids.end())
+        return std::nullopt;
+    return it->second;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::window_index(time_t window) const
+{
+    return std::find(m_windows.begin(), m_windows.end(), window) - m_windows.begin();
+}
+
+template<typename Engine>
+void basic_context<Engine>::book(time_t time, hotel_id_t hotel, client_id_t client_id,
+                                 room_t room_count)
+{
+    priv::op_timer timer{m_stats.book};
+    if (!m_options.reorder)
+        m_current_time = time;
+    add_booking({time, hotel, client_id, room_count});
+    reclaim(RECLAIM_STEP);
+}
+
+template<typename Engine>
+void basic_context<Engine>::add_booking(const book_request& req)
+{
+    auto& info = m_hotels[req.hotel];
+    auto  time = req.time;
+    bool  logged;
+    if (m_options.reorder) {
+        m_current_time = std::max(m_current_time, time);
+        time           = std::max(time, m_current_time - m_options.reorder);
+        logged         = info.insert({time, req.client, req.rooms});
+    } else {
+        logged = info.book({time, req.client, req.rooms});
     }
+    m_expiry.schedule(req.hotel, time);
+    if (m_options.history > 0)
+        m_history[req.hotel].add(time, req.client, req.rooms, m_options.history);
+    if constexpr (Engine::AGGREGATES)
+        mark_ranked(req.hotel);
 
-    if (it != m_bookings.begin())
-        m_bookings.erase(m_bookings.begin(), it);
+    if constexpr (STATS_ENABLED) {
+        auto& hotel = m_stats.hotels[req.hotel];
+        ++hotel.bookings;
+        hotel.peak_bookings = std::max<uint64_t>(hotel.peak_bookings, info.stored_bookings());
+        hotel.peak_clients  = std::max<uint64_t>(hotel.peak_clients, info.tracked_clients());
+        m_stats.stored_bookings += logged;
+        m_stats.peak_stored_bookings =
+            std::max(m_stats.peak_stored_bookings, m_stats.stored_bookings);
+    }
 }
-#else
-void hotel::book(booking &&info)
+
+template<typename Engine>
+void basic_context<Engine>::cleanup(hotel_id_t hotel)
 {
-    m_bookings.push_back(std::move(info));
+    priv::op_timer timer{m_stats.cleanup};
+    auto           evicted = m_hotels[hotel].remove_old(m_current_time, m_windows);
+    if constexpr (Engine::AGGREGATES)
+        mark_ranked(hotel);
+
+    if constexpr (STATS_ENABLED) {
+        auto& info = m_stats.hotels[hotel];
+        ++info.cleanups;
+        info.evicted += evicted;
+        m_stats.evicted.record(evicted);
+        m_stats.stored_bookings -= evicted;
+    }
 }
 
-size_t hotel::clients(time_t current_time)
+template<typename Engine>
+void basic_context<Engine>::clear()
 {
-    remove_old(current_time);
+    // Everything allocated from the context memory goes before it's released
+    m_hotels.clear();
+    m_history.clear();
+    m_names.clear();
+    m_hotel_ids.clear();
+    m_ranks.assign(m_ranks.size(), {});
+    m_rank_expiry.clear();
+    m_rank_pending.clear();
+    m_rank_marked.clear();
+    m_expiry = {};
+    m_batch_memo.clear();
+    m_memory.reset();
 
-    auto tmp = m_bookings;
-    std::sort(tmp.begin(), tmp.end(), [](auto const& a, auto const& b) {
-        return a.client < b.client;
-    });
-    auto last = std::unique(tmp.begin(), tmp.end(), [](auto const& a, auto const& b) {
-        return a.client == b.client;
-    });
-    return std::distance(tmp.begin(), last);
+    m_stats = {};
+    reset_stats();
+}
+
+template<typename Engine>
+void basic_context<Engine>::reset_stats()
+{
+    auto stored = m_stats.stored_bookings;
+    m_stats     = {};
+    if constexpr (STATS_ENABLED) {
+        m_stats.hotels.resize(m_hotels.size());
+        m_stats.stored_bookings = m_stats.peak_stored_bookings = stored;
+    }
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::stored_bookings() const
+{
+    size_t count = 0;
+    for (auto const& hotel : m_hotels)
+        count += hotel.stored_bookings();
+    return count;
 }
 
-size_t hotel::rooms(time_t current_time)
+template<typename Engine>
+size_t basic_context<Engine>::reclaim(size_t max_hotels)
 {
-    remove_old(current_time);
-    return std::accumulate(m_bookings.begin(), m_bookings.end(), size_t(0), [](auto prev, auto const& info) {
-        return prev + info.rooms;
+    return m_expiry.expire(m_current_time - m_max_window, max_hotels, [this](hotel_id_t hotel) {
+        cleanup(hotel);
     });
 }
 
-void hotel::remove_old(time_t current_time)
+template<typename Engine>
+size_t basic_context<Engine>::query(hotel_id_t hotel, size_t window, query_kind kind)
 {
-    if (m_bookings.empty()) {
+    if (hotel >= m_hotels.size() || window >= m_windows.size())
+        return 0;
+
+    priv::op_timer timer{kind == query_kind::clients ? m_stats.clients : m_stats.rooms};
+    cleanup(hotel);
+    auto& info = m_hotels[hotel];
+    return kind == query_kind::clients ? info.clients(window) : info.rooms(window);
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(hotel_id_t hotel)
+{
+    return query(hotel, 0, query_kind::clients);
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(hotel_id_t hotel)
+{
+    return query(hotel, 0, query_kind::rooms);
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(hotel_id_t hotel, time_t window)
+{
+    return query(hotel, window_index(window), query_kind::clients);
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(hotel_id_t hotel, time_t window)
+{
+    return query(hotel, window_index(window), query_kind::rooms);
+}
+
+template<typename Engine>
+void basic_context<Engine>::book(time_t time, std::string_view hotel_name, client_id_t client_id,
+                                 room_t room_count)
+{
+    book(time, intern(hotel_name), client_id, room_count);
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(std::string_view hotel_name)
+{
+    auto hotel = find(hotel_name);
+    return hotel ? clients(*hotel) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(std::string_view hotel_name)
+{
+    auto hotel = find(hotel_name);
+    return hotel ? rooms(*hotel) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(std::string_view hotel_name, time_t window)
+{
+    auto hotel = find(hotel_name);
+    return hotel ? clients(*hotel, window) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(std::string_view hotel_name, time_t window)
+{
+    auto hotel = find(hotel_name);
+    return hotel ? rooms(*hotel, window) : 0;
+}
+
+template<typename Engine>
+const priv::history_t* basic_context<Engine>::history(hotel_id_t hotel, time_t& from) const
+{
+    if (hotel >= m_history.size())
+        return nullptr;
+    from = std::max(from, m_current_time - m_options.history);
+    return &m_history[hotel];
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(hotel_id_t hotel, time_t from, time_t to) const
+{
+    auto info = history(hotel, from);
+    return info ? info->clients(from, to) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(hotel_id_t hotel, time_t from, time_t to) const
+{
+    auto info = history(hotel, from);
+    return info ? size_t(info->rooms(from, to)) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::clients(std::string_view hotel_name, time_t from, time_t to) const
+{
+    auto hotel = find(hotel_name);
+    return hotel ? clients(*hotel, from, to) : 0;
+}
+
+template<typename Engine>
+size_t basic_context<Engine>::rooms(std::string_view hotel_name, time_t from, time_t to) const
+{
+    auto hotel = find(hotel_name);
+    return hotel ? rooms(*hotel, from, to) : 0;
+}
+
+template<typename Engine>
+void basic_context<Engine>::mark_ranked(hotel_id_t hotel)
+{
+    if (m_rank_marked.size() <= hotel)
+        m_rank_marked.resize(m_hotels.size());
+    if (!m_rank_marked[hotel]) {
+        m_rank_marked[hotel] = true;
+        m_rank_pending.push_back(hotel);
+    }
+}
+
+template<typename Engine>
+void basic_context<Engine>::update_ranks()
+{
+    for (;;) {
+        for (auto hotel : m_rank_pending) {
+            m_rank_marked[hotel] = false;
+            rerank(hotel);
+        }
+        m_rank_pending.clear();
+
+        // Bookings with time <= current time - window are out of it, the clean up marks the
+        // hotels again and the next round ranks them
+        if (m_rank_expiry.empty() || m_rank_expiry.top_key() > m_current_time)
+            return;
+        while (!m_rank_expiry.empty() && m_rank_expiry.top_key() <= m_current_time) {
+            auto hotel = m_rank_expiry.top();
+            m_rank_expiry.erase(hotel);
+            cleanup(hotel);
+        }
+    }
+}
+
+template<typename Engine>
+void basic_context<Engine>::rerank(hotel_id_t hotel)
+{
+    auto const& info = m_hotels[hotel];
+    auto        rank = [hotel](auto& heap, size_t value) {
+        if (value)
+            heap.set(hotel, value);
+        else
+            heap.erase(hotel);
+    };
+    for (size_t w = 0; w < m_windows.size(); ++w) {
+        rank(m_ranks[w].rooms, info.rooms(w));
+        rank(m_ranks[w].clients, info.clients(w));
+    }
+
+    if (auto expiry = info.next_expiry(m_windows))
+        m_rank_expiry.set(hotel, *expiry);
+    else
+        m_rank_expiry.erase(hotel);
+}
+
+template<typename Engine>
+std::vector<ranked_hotel> basic_context<Engine>::top(size_t k, size_t window, query_kind kind)
+{
+    std::vector<ranked_hotel> report;
+    if (window >= m_windows.size())
+        return report;
+
+    if constexpr (Engine::AGGREGATES) {
+        update_ranks();
+
+        auto const& ranks = kind == query_kind::clients ? m_ranks[window].clients
+                                                        : m_ranks[window].rooms;
+        report.reserve(std::min(k, ranks.size()));
+        ranks.for_each_first(k, [&](uint32_t hotel, size_t value) {
+            report.push_back({hotel, value});
+        });
+    } else {
+        for (hotel_id_t hotel = 0; hotel < m_hotels.size(); ++hotel) {
+            if (auto value = query(hotel, window, kind))
+                report.push_back({hotel, value});
+        }
+        auto first = [](const ranked_hotel& a, const ranked_hotel& b) {
+            return a.value > b.value || (a.value == b.value && a.hotel < b.hotel);
+        };
+        k = std::min(k, report.size());
+        std::partial_sort(report.begin(), report.begin() + ptrdiff_t(k), report.end(), first);
+        report.resize(k);
+    }
+    return report;
+}
+
+template<typename Engine>
+std::vector<ranked_hotel> basic_context<Engine>::top_rooms(size_t k)
+{
+    return top(k, 0, query_kind::rooms);
+}
+
+template<typename Engine>
+std::vector<ranked_hotel> basic_context<Engine>::top_clients(size_t k)
+{
+    return top(k, 0, query_kind::clients);
+}
+
+template<typename Engine>
+std::vector<ranked_hotel> basic_context<Engine>::top_rooms(size_t k, time_t window)
+{
+    return top(k, window_index(window), query_kind::rooms);
+}
+
+template<typename Engine>
+std::vector<ranked_hotel> basic_context<Engine>::top_clients(size_t k, time_t window)
+{
+    return top(k, window_index(window), query_kind::clients);
+}
+
+template<typename Engine>
+void basic_context<Engine>::book_batch(std::span<const book_request> requests)
+{
+    if (requests.empty())
         return;
+
+    uint64_t start = 0;
+    if constexpr (STATS_ENABLED)
+        start = priv::ticks();
+
+    // Per-hotel order is all that matters, so bookings are applied in input order: sorting them by
+    // hotel costs more than it saves.
+    for (auto const& req : requests)
+        add_booking(req);
+
+    if (!m_options.reorder)
+        m_current_time = requests.back().time;
+    reclaim(RECLAIM_STEP * requests.size());
+
+    // Batch cost is spread over its bookings
+    if constexpr (STATS_ENABLED)
+        m_stats.book.record((priv::ticks() - start) / requests.size(), requests.size());
+}
+
+template<typename Engine>
+void basic_context<Engine>::query_batch(std::span<const query_request> requests,
+                                        std::span<size_t> answers)
+{
+    auto windows = m_windows.size();
+    if (m_batch_memo.size() < m_hotels.size() * windows)
+        m_batch_memo.resize(m_hotels.size() * windows);
+    ++m_batch_stamp;
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+        auto const& req = requests[i];
+        if (req.hotel >= m_hotels.size() || req.window >= windows) {
+            answers[i] = 0;
+            continue;
+        }
+
+        priv::op_timer timer{req.kind == query_kind::clients ? m_stats.clients : m_stats.rooms};
+
+        auto& hotel = m_hotels[req.hotel];
+        auto  memo  = &m_batch_memo[req.hotel * windows];
+        if (memo->stamp != m_batch_stamp) {
+            cleanup(req.hotel);
+            for (size_t w = 0; w < windows; ++w)
+                memo[w] = {m_batch_stamp, NO_ANSWER, NO_ANSWER};
+        }
+
+        auto& answer = memo[req.window];
+        if (req.kind == query_kind::clients) {
+            if (answer.clients == NO_ANSWER)
+                answer.clients = hotel.clients(req.window);
+            answers[i] = answer.clients;
+        } else {
+            if (answer.rooms == NO_ANSWER)
+                answer.rooms = hotel.rooms(req.window);
+            answers[i] = answer.rooms;
+        }
+    }
+}
+
+namespace {
+
+constexpr char     SNAPSHOT_MAGIC[8] = {'H', 'P', 'S', 'N', 'A', 'P', 0, 0};
+constexpr uint32_t SNAPSHOT_VERSION  = 4;
+
+} // ::anonymous
+
+template<typename Engine>
+bool basic_context<Engine>::save(const char* path) const
+{
+    std::ofstream         ofs{path, std::ios::binary | std::ios::trunc};
+    priv::snapshot_writer out{ofs};
+
+    out.value(SNAPSHOT_MAGIC);
+    out.value(SNAPSHOT_VERSION);
+    out.value(uint32_t(Engine::KIND));
+    out.value(uint64_t(m_windows.size()));
+    out.array(m_windows.data(), m_windows.size());
+    out.value(m_options);
+    out.value(int64_t(m_current_time));
+
+    // Names in ID order, hotels are interned again on load
+    out.value(uint64_t(m_hotels.size()));
+    for (hotel_id_t id = 0; id < m_hotels.size(); ++id) {
+        out.value(uint64_t(m_names[id].size()));
+        out.array(m_names[id].data(), m_names[id].size());
+        m_hotels[id].save(out);
+        if (m_options.history > 0)
+            m_history[id].save(out);
     }
+    m_expiry.save(out);
 
-    auto it = std::upper_bound(m_bookings.begin(), m_bookings.end(), current_time - TIME_WINDOW,
-                               [](auto tm, auto const& info) {
-                                   return tm < info.time;
-                               });
-    m_bookings.erase(m_bookings.begin(), it);
+    ofs.close();
+    return bool(ofs);
+}
+
+template<typename Engine>
+bool basic_context<Engine>::load(const char* path)
+{
+    input_buffer buffer;
+    if (!buffer.open(path))
+        return false;
+
+    priv::snapshot_reader in{buffer.data()};
+
+    char     magic[sizeof(SNAPSHOT_MAGIC)];
+    uint32_t version, kind;
+    uint64_t windows_count;
+    if (!in.value(magic) || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) ||
+        !in.value(version) || version != SNAPSHOT_VERSION || !in.value(kind) ||
+        kind != uint32_t(Engine::KIND) || !in.value(windows_count) || !windows_count ||
+        !in.fits(windows_count, sizeof(time_t)))
+        return false;
+
+    std::vector<time_t> windows(windows_count);
+    engine_options      options;
+    int64_t             current_time;
+    uint64_t            hotels;
+    if (!in.array(windows.data(), windows.size()) || !in.value(options) ||
+        !in.value(current_time) || !in.value(hotels) || !in.fits(hotels, sizeof(uint64_t)))
+        return false;
+
+    basic_context loaded{std::move(windows), options, m_memory.options()};
+    loaded.m_current_time = current_time;
+
+    std::string name;
+    for (uint64_t id = 0; id < hotels; ++id) {
+        uint64_t length;
+        if (!in.value(length) || !in.fits(length, 1))
+            return false;
+        name.resize(length);
+        if (!in.array(name.data(), name.size()) || loaded.intern(name) != id ||
+            !loaded.m_hotels[id].load(in))
+            return false;
+        if (options.history > 0 && !loaded.m_history[id].load(in))
+            return false;
+    }
+
+    if (!loaded.m_expiry.load(in, hotels) || !in.done())
+        return false;
+
+    // Ranking is derived from the hotels
+    if constexpr (Engine::AGGREGATES) {
+        for (hotel_id_t id = 0; id < hotels; ++id)
+            loaded.rerank(id);
+    }
+
+    *this = std::move(loaded);
+    reset_stats();
+    if constexpr (STATS_ENABLED)
+        m_stats.stored_bookings = m_stats.peak_stored_bookings = stored_bookings();
+    return true;
+}
+
+template class basic_context<priv::cached_engine>;
+template class basic_context<priv::lazy_engine>;
+template class basic_context<priv::approx_engine>;
+
+any_context make_context(engine_kind engine, std::vector<time_t> windows, engine_options options,
+                         memory_options memory)
+{
+    switch (engine) {
+        case engine_kind::cached:
+            return any_context{std::in_place_type<cached_context>, std::move(windows), options,
+                               memory};
+        case engine_kind::lazy:
+            return any_context{std::in_place_type<lazy_context>, std::move(windows), options,
+                               memory};
+        case engine_kind::approx:
+            return any_context{std::in_place_type<approx_context>, std::move(windows), options,
+                               memory};
+    }
+    return make_context(DEFAULT_ENGINE, std::move(windows), options, memory);
+}
+
+std::optional<engine_kind> parse_engine(std::string_view name)
+{
+    if (name == "cached")
+        return engine_kind::cached;
+    if (name == "lazy")
+        return engine_kind::lazy;
+    if (name == "approx")
+        return engine_kind::approx;
+    return std::nullopt;
 }
-#endif
 
-} // ::priv
 } // ::hotel_processing
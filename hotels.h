@@ -1,26 +1,105 @@
 #pragma once
 
-#include <deque>
+#include <cstdint>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <optional>
+#include <span>
+#include <vector>
 #include <map>
 #include <algorithm>
 #include <numeric>
+#include <variant>
+
+#include "booking_history.h"
+#include "booking_log.h"
+#include "expiry_wheel.h"
+#include "flat_map.h"
+#include "indexed_heap.h"
+#include "memory.h"
+#include "sliding_hll.h"
+#include "stats.h"
 
 namespace hotel_processing {
 
 using time_t       = int64_t;
 using client_id_t  = uint32_t;
 using room_t       = size_t;
+using hotel_id_t   = uint32_t;
 
-// fwd
 namespace priv {
-struct hotel;
+// Allows lookup by std::string_view without temporary std::string
+struct name_hash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const noexcept
+    {
+        return std::hash<std::string_view>{}(name);
+    }
+};
 } // ::priv
 
-using hotels_map_t = std::unordered_map<std::string, priv::hotel>;
+using hotel_ids_map_t = std::unordered_map<std::string, hotel_id_t, priv::name_hash, std::equal_to<>>;
 
 static inline constexpr time_t TIME_WINDOW = 24*60*60;
 
+// Never returned by context::intern(), queries for it are answered with zero
+static inline constexpr hotel_id_t INVALID_HOTEL = hotel_id_t(-1);
+
+struct book_request
+{
+    time_t      time;
+    hotel_id_t  hotel;
+    client_id_t client;
+    room_t      rooms;
+};
+
+enum class query_kind : uint8_t
+{
+    clients,
+    rooms,
+};
+
+struct query_request
+{
+    query_kind kind;
+    hotel_id_t hotel;
+    uint32_t   window{}; // index of the context window
+};
+
+// Entry of a top hotels report
+struct ranked_hotel
+{
+    hotel_id_t hotel;
+    size_t     value;
+};
+
+enum class engine_kind : uint8_t
+{
+    cached,
+    lazy,
+    approx,
+};
+
+// Engine settings, every engine uses the ones it needs
+struct engine_options
+{
+    // relative standard error of the approximate clients estimation
+    double clients_error{0.1};
+    // seconds of booking history kept for range queries, 0 disables them
+    time_t history{};
+    /**
+     * Reorder tolerance in seconds, 0 keeps bookings in arrival order. Otherwise current time is
+     * the latest booking time and never goes backwards, bookings up to `reorder` seconds older
+     * than it are inserted in time order, so eviction stays exact; older ones are booked at
+     * current time - reorder. It's kept below the smallest window. History records late bookings
+     * at the latest booking time of the hotel.
+     */
+    time_t reorder{};
+};
+
 namespace priv {
 struct booking
 {
@@ -29,64 +108,505 @@ struct booking
     room_t      rooms;
 };
 
+using bookings_t = booking_log<time_t, client_id_t, room_t>;
+using history_t  = booking_history<time_t, client_id_t, room_t>;
 
-#ifdef CACHED
-struct hotel
+/**
+ * Engines
+ *
+ * An engine defines how a hotel answers queries from its booking log. It provides per-hotel
+ * `hotel_state` with:
+ *
+ *  - hotel_state(windows, options, memory)  storage is allocated from the memory resource
+ *  - book(info)                       new booking, it's inside all windows
+ *  - merge(info)                      booking merged into the logged one of the same time and
+ *                                     client, it's inside all windows
+ *  - evict(window, time, client, rooms)  booking left the window, only called with EVICT_SCAN
+ *  - cleaned(current_time, windows)   hotel was cleaned up at the time
+ *  - clients(window, log, first), rooms(window, log, first)
+ *                                     answers, `first` is the first window booking in the log
+ *  - save(out), load(in)              snapshot of the state
+ *  - tracked_clients()                per-client entries kept, for statistics
+ *
+ * With EVICT_SCAN set, bookings leaving the window are visited one by one; otherwise the window
+ * start is found by binary search. With AGGREGATES set, clients() and rooms() are O(1), so the
+ * context keeps hotels ranked by them.
+ */
+
+// Exact aggregates kept up to date on every booking and eviction, queries are O(1)
+struct cached_engine
 {
-    void book(booking&& info);
+    static constexpr engine_kind KIND       = engine_kind::cached;
+    static constexpr bool        EVICT_SCAN = true;
+    static constexpr bool        AGGREGATES = true;
 
-    size_t clients(time_t current_time);
+    class hotel_state
+    {
+    public:
+        hotel_state(size_t windows, const engine_options&, std::pmr::memory_resource* memory);
 
-    size_t rooms(time_t current_time);
+        void book(const booking& info);
+        void merge(const booking& info);
+        void evict(size_t window, time_t, client_id_t client, room_t rooms);
+        void cleaned(time_t, std::span<const time_t>) {}
 
-private:
-    void setup(room_t rooms, client_id_t client);
+        size_t clients(size_t window, const bookings_t&, size_t) const
+        {
+            return m_windows[window].client_bookings.size();
+        }
 
-    void cleanup(room_t rooms, client_id_t client);
+        size_t rooms(size_t window, const bookings_t&, size_t) const
+        {
+            return m_windows[window].rooms;
+        }
 
-    // Remove old entries
-    void remove_old(time_t current_time);
+        size_t tracked_clients() const;
 
-private:
-    std::deque<booking> m_bookings;
-    // Cache
-    std::unordered_map<client_id_t, size_t> m_client_bookings;
-    size_t m_rooms{};
+        void save(snapshot_writer& out) const;
+        bool load(snapshot_reader& in);
+
+    private:
+        struct window_state
+        {
+            // bookings count per client
+            flat_map client_bookings;
+            size_t   rooms{};
+        };
+
+        std::pmr::vector<window_state> m_windows;
+    };
 };
-#else
+
+// Nothing but the log is kept, queries walk the window bookings
+struct lazy_engine
+{
+    static constexpr engine_kind KIND       = engine_kind::lazy;
+    static constexpr bool        EVICT_SCAN = false;
+    static constexpr bool        AGGREGATES = false;
+
+    class hotel_state
+    {
+    public:
+        hotel_state(size_t, const engine_options&, std::pmr::memory_resource*) {}
+
+        void book(const booking&) {}
+        void merge(const booking&) {}
+        void evict(size_t, time_t, client_id_t, room_t) {}
+        void cleaned(time_t, std::span<const time_t>) {}
+
+        size_t clients(size_t window, const bookings_t& bookings, size_t first) const;
+        size_t rooms(size_t window, const bookings_t& bookings, size_t first) const;
+
+        void save(snapshot_writer&) const {}
+        bool load(snapshot_reader&) { return true; }
+
+        size_t tracked_clients() const { return 0; }
+    };
+};
+
+// Exact rooms, clients are estimated by sliding HyperLogLog with fixed memory per hotel
+struct approx_engine
+{
+    static constexpr engine_kind KIND       = engine_kind::approx;
+    static constexpr bool        EVICT_SCAN = true;
+    static constexpr bool        AGGREGATES = true;
+
+    class hotel_state
+    {
+    public:
+        hotel_state(size_t windows, const engine_options& options,
+                    std::pmr::memory_resource* memory);
+
+        void book(const booking& info);
+        void merge(const booking& info);
+        void evict(size_t window, time_t, client_id_t, room_t rooms) { m_rooms[window] -= rooms; }
+        void cleaned(time_t current_time, std::span<const time_t> windows);
+
+        size_t clients(size_t window, const bookings_t&, size_t) const
+        {
+            return m_estimator.estimate(m_since[window]);
+        }
+
+        size_t rooms(size_t window, const bookings_t&, size_t) const { return m_rooms[window]; }
+
+        size_t tracked_clients() const { return 0; }
+
+        void save(snapshot_writer& out) const;
+        bool load(snapshot_reader& in);
+
+    private:
+        sliding_hll<time_t>      m_estimator;
+        // window start at the last clean up, per window
+        std::pmr::vector<time_t> m_since;
+        std::pmr::vector<size_t> m_rooms;
+    };
+};
+
+/**
+ * Hotels keep one booking log for all context windows. Every window has its own position of the
+ * first booking inside it. The log keeps bookings for the largest window only.
+ *
+ * A booking with the same time and client as a logged booking inside all windows only adds its
+ * rooms to it, so the log keeps one entry per distinct (time, client) pair and duplicates cost
+ * neither memory nor eviction work.
+ */
+template<typename Engine>
 struct hotel
 {
-    void book(booking&& info);
+    hotel(size_t windows, const engine_options& options, std::pmr::memory_resource* memory) :
+        m_bookings(memory),
+        m_first(windows, memory),
+        m_state(windows, options, memory)
+    {
+    }
+
+    // Returns false if the booking was merged into a logged one
+    bool book(booking&& info)
+    {
+        if (merge(info))
+            return false;
+        m_state.book(info);
+        m_bookings.push_back(info.time, info.client, info.rooms);
+        return true;
+    }
+
+    /**
+     * Book keeping the log ordered by time. The booking must be later than the window start of
+     * every window at the last clean up, so it's never inserted before m_first.
+     */
+    bool insert(booking&& info)
+    {
+        if (merge(info))
+            return false;
+        m_state.book(info);
+        m_bookings.insert_sorted(info.time, info.client, info.rooms);
+        return true;
+    }
+
+    /**
+     * Book keeping the log ordered by time, the booking may be older than window starts at the
+     * last clean up at `cleaned`: windows it has already left evict it right away.
+     */
+    bool insert(booking&& info, time_t cleaned, std::span<const time_t> windows)
+    {
+        if (merge(info))
+            return false;
+        m_state.book(info);
+        m_bookings.insert_sorted(info.time, info.client, info.rooms);
+        for (size_t w = 0; w < windows.size(); ++w) {
+            // It's logged right before the first booking inside the window
+            if (info.time + windows[w] <= cleaned) {
+                m_state.evict(w, info.time, info.client, info.rooms);
+                ++m_first[w];
+            }
+        }
+        return true;
+    }
+
+    // Remove old entries, returns bookings dropped from the log
+    size_t remove_old(time_t current_time, std::span<const time_t> windows);
 
-    size_t clients(time_t current_time);
+    // Values for already cleaned up hotel
+    size_t clients(size_t window = 0) const
+    {
+        return m_state.clients(window, m_bookings, m_first[window]);
+    }
 
-    size_t rooms(time_t current_time);
+    size_t rooms(size_t window = 0) const
+    {
+        return m_state.rooms(window, m_bookings, m_first[window]);
+    }
+
+    size_t stored_bookings() const { return m_bookings.size(); }
+    size_t tracked_clients() const { return m_state.tracked_clients(); }
+
+    /**
+     * Time the values of some window change next by eviction: when the first booking inside it
+     * leaves it. None if no window has bookings.
+     */
+    std::optional<time_t> next_expiry(std::span<const time_t> windows) const
+    {
+        std::optional<time_t> expiry;
+        for (size_t w = 0; w < windows.size(); ++w) {
+            if (m_first[w] < m_bookings.size()) {
+                auto time = m_bookings.time(m_first[w]) + windows[w];
+                expiry    = expiry ? std::min(*expiry, time) : time;
+            }
+        }
+        return expiry;
+    }
+
+    void save(snapshot_writer& out) const;
+    bool load(snapshot_reader& in);
 
 private:
-    // Remove old entries
-    void remove_old(time_t current_time);
+    // Merge into the booking of the same time and client if it's inside all windows
+    bool merge(const booking& info)
+    {
+        auto idx = m_bookings.find(info.time, info.client);
+        if (idx == m_bookings.size() || idx < *std::max_element(m_first.begin(), m_first.end()))
+            return false;
+        m_bookings.add_rooms(idx, info.rooms);
+        m_state.merge(info);
+        return true;
+    }
 
 private:
-    std::deque<booking> m_bookings;
+    bookings_t                   m_bookings;
+    // first booking in the window, per window
+    std::pmr::vector<size_t>     m_first;
+    typename Engine::hotel_state m_state;
 };
-#endif
 
 } // ::priv
 
-class context
+/**
+ * Hotels booking context, `Engine` is one of the priv engines. Use the aliases below, or
+ * make_context() to choose the engine at run time.
+ */
+template<typename Engine>
+class basic_context
 {
 public:
+    /**
+     * @param windows  time windows to answer queries for, bookings are stored once for all
+     *                 of them. Queries without window use the first one.
+     * @param options  engine settings
+     * @param memory   allocator of the hotels storage, the context owns it
+     */
+    explicit basic_context(std::vector<time_t> windows = {TIME_WINDOW}, engine_options options = {},
+                           memory_options memory = {});
+
+    // Hotel ID for the name, new hotel is registered on first use. IDs are stable for the context
+    // lifetime.
+    hotel_id_t intern(std::string_view hotel_name);
+
+    // Hotel ID lookup, never registers new hotels
+    std::optional<hotel_id_t> find(std::string_view hotel_name) const;
+
+    // Name of the registered hotel
+    std::string_view hotel_name(hotel_id_t hotel) const { return m_names[hotel]; }
+
+    void book(time_t time, hotel_id_t hotel, client_id_t client_id, room_t room_count);
+
+    size_t clients(hotel_id_t hotel);
+
+    size_t rooms(hotel_id_t hotel);
+
+    // Name-based versions. Queries for unknown hotels do not register them.
+    void book(time_t time, std::string_view hotel_name, client_id_t client_id, room_t room_count);
+
+    size_t clients(std::string_view hotel_name);
+
+    size_t rooms(std::string_view hotel_name);
+
+    // Queries for the given window, it must be one of the context windows
+    size_t clients(hotel_id_t hotel, time_t window);
+
+    size_t rooms(hotel_id_t hotel, time_t window);
+
+    size_t clients(std::string_view hotel_name, time_t window);
+
+    size_t rooms(std::string_view hotel_name, time_t window);
+
+    /**
+     * Range queries over the booking history: bookings with from < time <= to. Only bookings
+     * inside the history retention at the current time are counted, see engine_options::history;
+     * without history the answer is zero. Both take O(log n).
+     *
+     * For streams with non-decreasing time, rooms(hotel, current_time() - window, current_time())
+     * equals rooms(hotel, window) when the retention covers the window, same for clients.
+     */
+    size_t clients(hotel_id_t hotel, time_t from, time_t to) const;
+
+    size_t rooms(hotel_id_t hotel, time_t from, time_t to) const;
+
+    size_t clients(std::string_view hotel_name, time_t from, time_t to) const;
+
+    size_t rooms(std::string_view hotel_name, time_t from, time_t to) const;
+
+    /**
+     * Hotels with the most rooms or clients in the window at the current time, best first, equal
+     * values by lower ID. Hotels without bookings in the window aren't listed. Without window
+     * the first one is used, an unknown window gets an empty report.
+     *
+     * Engines with aggregates (cached, approx) keep the hotels ranked: bookings and clean ups
+     * mark the hotel, a report reranks the marked ones and the ones with expired bookings in
+     * O(log n) each and lists the first k in O(k log k). The lazy engine queries every hotel.
+     */
+    std::vector<ranked_hotel> top_rooms(size_t k);
+
+    std::vector<ranked_hotel> top_clients(size_t k);
+
+    std::vector<ranked_hotel> top_rooms(size_t k, time_t window);
+
+    std::vector<ranked_hotel> top_clients(size_t k, time_t window);
+
+    std::span<const time_t> windows() const { return m_windows; }
+
+    // Index of the window in windows(), windows().size() if it's not there
+    size_t window_index(time_t window) const;
+
+    /**
+     * Book requests in the given order. Same as book() for each of them.
+     */
+    void book_batch(std::span<const book_request> requests);
+
+    /**
+     * Answer queries at the current time. Each hotel is cleaned up once per batch, and its
+     * clients/rooms values are computed once and shared by all queries for it.
+     *
+     * @param requests  queries, INVALID_HOTEL ones are answered with zero
+     * @param answers   answers in the requests order, at least requests.size() elements
+     */
+    void query_batch(std::span<const query_request> requests, std::span<size_t> answers);
 
-    void book(time_t time, const std::string& hotel_name, client_id_t client_id, room_t room_count);
+    /**
+     * Clean up hotels whose bookings are out of the window at the current time. book() does it
+     * in small steps by itself, so it's only needed to reclaim everything at once.
+     *
+     * @param max_hotels  step limit
+     * @return hotels cleaned up
+     */
+    size_t reclaim(size_t max_hotels = size_t(-1));
 
-    size_t clients(const std::string& hotel_name);
+    // Hotels waiting for the clean up
+    size_t reclaim_pending() const { return m_expiry.pending(); }
 
-    size_t rooms(const std::string& hotel_name);
+    // Current time used by queries. book() sets it to the booking time (the latest booking time
+    // with reorder tolerance).
+    void   set_time(time_t time) { m_current_time = time; }
+    time_t current_time() const { return m_current_time; }
+
+    size_t hotels_count() const { return m_hotels.size(); }
+
+    // Bookings kept in memory by all hotels
+    size_t stored_bookings() const;
+
+    // Drop all hotels with their bookings and history, windows, settings and current time are
+    // kept. Pool and arena memory of the hotels is released at once.
+    void clear();
+
+    /**
+     * Save the whole context state to a file: settings, current time, hotels with their booking
+     * logs, engine state and history, and the expiry wheel. Booking log columns are stored as they
+     * are in memory, packed ones included, so each one is loaded with a single copy.
+     *
+     * @return false on write failure
+     */
+    bool save(const char* path) const;
+
+    /**
+     * Replace the context state with a snapshot saved by a context with the same engine, windows
+     * and settings are taken from the snapshot, memory options are kept. The context is left
+     * unchanged on failure.
+     *
+     * @return false if the file can't be read, is malformed or was saved by another engine
+     */
+    bool load(const char* path);
+
+    // Operation latencies and per-hotel counters, empty unless built with ENABLE_STATS
+    const context_stats& stats() const { return m_stats; }
+    void                 reset_stats();
+
+private:
+    size_t query(hotel_id_t hotel, size_t window, query_kind kind);
+
+    // Book without reclaim, current time is only updated with reorder tolerance
+    void add_booking(const book_request& req);
+
+    // Clean up the hotel at the current time
+    void cleanup(hotel_id_t hotel);
+
+    // History of the hotel clamped to the retention, nullptr if there's nothing to count
+    const priv::history_t* history(hotel_id_t hotel, time_t& from) const;
+
+    std::vector<ranked_hotel> top(size_t k, size_t window, query_kind kind);
+
+    // Rank the hotel on the next report, engines with aggregates only
+    void mark_ranked(hotel_id_t hotel);
+
+    // Rank the marked hotels and the ones with expired bookings
+    void update_ranks();
+
+    // Update the ranking with the hotel values
+    void rerank(hotel_id_t hotel);
 
 private:
-    time_t       m_current_time{};
-    hotels_map_t m_hotels;
+    std::vector<time_t>              m_windows;
+    time_t                           m_max_window{};
+    engine_options                   m_options;
+    time_t                           m_current_time{};
+    hotel_ids_map_t                  m_hotel_ids;
+    // keys of m_hotel_ids by ID
+    std::vector<std::string_view>    m_names;
+    // storage of the hotels and their history, outlives them
+    context_memory                   m_memory;
+    std::vector<priv::hotel<Engine>> m_hotels;
+    // per hotel, empty without history retention
+    std::vector<priv::history_t>     m_history;
+
+    // Hotels ranked by their values per window, kept by engines with aggregates
+    struct window_ranks
+    {
+        priv::indexed_heap<size_t, std::greater<>> rooms;
+        priv::indexed_heap<size_t, std::greater<>> clients;
+    };
+    std::vector<window_ranks>        m_ranks;
+    // Ranked hotels by the time their values change next by eviction
+    priv::indexed_heap<time_t>       m_rank_expiry;
+    // Hotels booked or cleaned up since the last report, m_rank_marked is set for them
+    std::vector<hotel_id_t>          m_rank_pending;
+    std::vector<bool>                m_rank_marked;
+    context_stats                    m_stats;
+
+    // Hotels cleaned up per booking, enough to outpace the wheel growth
+    static constexpr size_t RECLAIM_STEP = 4;
+
+    priv::expiry_wheel<time_t, hotel_id_t> m_expiry;
+
+    // Answers computed by the current query batch, per hotel and window
+    struct batch_memo
+    {
+        uint64_t stamp{};
+        size_t   clients{};
+        size_t   rooms{};
+    };
+    static constexpr size_t NO_ANSWER = size_t(-1);
+
+    std::vector<batch_memo> m_batch_memo;
+    uint64_t                m_batch_stamp{};
 };
 
+// Instantiated in hotels.cpp
+extern template struct priv::hotel<priv::cached_engine>;
+extern template struct priv::hotel<priv::lazy_engine>;
+extern template struct priv::hotel<priv::approx_engine>;
+extern template class basic_context<priv::cached_engine>;
+extern template class basic_context<priv::lazy_engine>;
+extern template class basic_context<priv::approx_engine>;
+
+using cached_context = basic_context<priv::cached_engine>;
+using lazy_context   = basic_context<priv::lazy_engine>;
+using approx_context = basic_context<priv::approx_engine>;
+
+// Build default engine, see USE_CACHE
+#ifdef CACHED
+using context = cached_context;
+static inline constexpr engine_kind DEFAULT_ENGINE = engine_kind::cached;
+#else
+using context = lazy_context;
+static inline constexpr engine_kind DEFAULT_ENGINE = engine_kind::lazy;
+#endif
+
+using any_context = std::variant<cached_context, lazy_context, approx_context>;
+
+// Context with the engine chosen at run time, dispatch once with std::visit
+any_context make_context(engine_kind engine = DEFAULT_ENGINE,
+                         std::vector<time_t> windows = {TIME_WINDOW}, engine_options options = {},
+                         memory_options memory = {});
+
+// Engine by its name: "cached", "lazy" or "approx"
+std::optional<engine_kind> parse_engine(std::string_view name);
 
 } // ::hotel_processing
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The indexed_heap class
+ *
+ * Binary heap of keys by uint32_t IDs, each ID at most once. Keys of present IDs can be changed
+ * or erased in O(log n) through the position index, and the first k entries are visited in
+ * O(k log k) without touching the rest. Compare(a, b) is true when key a goes before b; entries
+ * with equivalent keys go by ID.
+ */
+template<typename Key, typename Compare = std::less<Key>>
+class indexed_heap
+{
+public:
+    size_t size() const { return m_heap.size(); }
+    bool   empty() const { return m_heap.empty(); }
+
+    bool contains(uint32_t id) const { return id < m_pos.size() && m_pos[id] != NONE; }
+
+    // The first entry, heap must not be empty
+    uint32_t   top() const { return m_heap[0].id; }
+    const Key& top_key() const { return m_heap[0].key; }
+
+    // Insert the ID or change its key
+    void set(uint32_t id, Key key)
+    {
+        if (!contains(id)) {
+            if (id >= m_pos.size())
+                m_pos.resize(size_t(id) + 1, NONE);
+            m_heap.push_back({key, id});
+            sift_up(m_heap.size() - 1);
+            return;
+        }
+
+        auto  idx   = m_pos[id];
+        auto& entry = m_heap[idx];
+        if (!m_compare(entry.key, key) && !m_compare(key, entry.key))
+            return;
+        bool up   = m_compare(key, entry.key);
+        entry.key = key;
+        if (up)
+            sift_up(idx);
+        else
+            sift_down(idx);
+    }
+
+    void erase(uint32_t id)
+    {
+        if (!contains(id))
+            return;
+        auto idx  = m_pos[id];
+        m_pos[id] = NONE;
+
+        auto last = m_heap.back();
+        m_heap.pop_back();
+        if (idx == m_heap.size())
+            return;
+        place(idx, last);
+        sift_up(idx);
+        sift_down(m_pos[last.id]);
+    }
+
+    void clear()
+    {
+        m_heap.clear();
+        m_pos.clear();
+    }
+
+    /**
+     * Visit the first `count` entries in order, best first search from the root: only the
+     * visited entries and their children are looked at
+     *
+     * @param f  callable with (uint32_t id, const Key& key)
+     */
+    template<typename F>
+    void for_each_first(size_t count, F&& f) const
+    {
+        count = std::min(count, m_heap.size());
+        if (!count)
+            return;
+
+        // Heap positions, the candidate going first is at the front
+        std::vector<uint32_t> candidates{0};
+        candidates.reserve(count + 1);
+        auto after = [this](uint32_t a, uint32_t b) {
+            return before(m_heap[b], m_heap[a]);
+        };
+        for (size_t i = 0; i < count; ++i) {
+            std::pop_heap(candidates.begin(), candidates.end(), after);
+            auto idx = candidates.back();
+            candidates.pop_back();
+            f(m_heap[idx].id, m_heap[idx].key);
+
+            for (auto child : {idx * 2 + 1, idx * 2 + 2}) {
+                if (child < m_heap.size()) {
+                    candidates.push_back(child);
+                    std::push_heap(candidates.begin(), candidates.end(), after);
+                }
+            }
+        }
+    }
+
+private:
+    static constexpr uint32_t NONE = uint32_t(-1);
+
+    struct entry
+    {
+        Key      key;
+        uint32_t id;
+    };
+
+    bool before(const entry& a, const entry& b) const
+    {
+        if (m_compare(a.key, b.key))
+            return true;
+        if (m_compare(b.key, a.key))
+            return false;
+        return a.id < b.id;
+    }
+
+    void place(size_t idx, const entry& item)
+    {
+        m_heap[idx]    = item;
+        m_pos[item.id] = uint32_t(idx);
+    }
+
+    void sift_up(size_t idx)
+    {
+        auto item = m_heap[idx];
+        while (idx > 0) {
+            auto parent = (idx - 1) / 2;
+            if (!before(item, m_heap[parent]))
+                break;
+            place(idx, m_heap[parent]);
+            idx = parent;
+        }
+        place(idx, item);
+    }
+
+    void sift_down(size_t idx)
+    {
+        auto item = m_heap[idx];
+        for (;;) {
+            auto child = idx * 2 + 1;
+            if (child >= m_heap.size())
+                break;
+            if (child + 1 < m_heap.size() && before(m_heap[child + 1], m_heap[child]))
+                ++child;
+            if (!before(m_heap[child], item))
+                break;
+            place(idx, m_heap[child]);
+            idx = child;
+        }
+        place(idx, item);
+    }
+
+private:
+    std::vector<entry>    m_heap;
+    // heap position by ID, NONE if absent
+    std::vector<uint32_t> m_pos;
+    Compare               m_compare;
+};
+
+} // ::priv
+} // ::hotel_processing
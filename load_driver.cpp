@@ -0,0 +1,216 @@
+/**
+ *
+ * Load driver of the socket server (hotel-processing -L SOCKET)
+ *
+ * Every session is a thread with its own connection sending rounds of BOOKS bookings followed by
+ * one CLIENTS or ROOMS query and waiting for the answer, so there's one round in flight per
+ * session. Booking times come from a clock shared by all sessions and never go back. Reports
+ * requests per second and the round trip latency of the rounds.
+ *
+ * Usage:
+ *    load_driver [-c SESSIONS] [-n ROUNDS] [-b BOOKS] [-H HOTELS] [-C CLIENTS] SOCKET
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fmt/format.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "stats.h"
+
+namespace dt = std::chrono;
+
+namespace {
+
+struct settings
+{
+    unsigned    sessions{8};
+    size_t      rounds{10'000};
+    size_t      books{16};
+    size_t      hotels{1'000};
+    size_t      clients{100'000};
+    const char* path{};
+};
+
+struct session_result
+{
+    bool                  ok{};
+    std::vector<uint64_t> latencies; // ns per round
+};
+
+int connect_to(const char* path)
+{
+    sockaddr_un addr{};
+    if (std::strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool send_all(int fd, const char* data, size_t size)
+{
+    while (size) {
+        auto ret = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += ret;
+        size -= size_t(ret);
+    }
+    return true;
+}
+
+// Reads up to the end of the answer line, bytes after it are kept in `pending`
+bool read_line(int fd, std::string& pending)
+{
+    char buffer[4096];
+    for (;;) {
+        auto end = pending.find('\n');
+        if (end != std::string::npos) {
+            pending.erase(0, end + 1);
+            return true;
+        }
+        auto ret = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        pending.append(buffer, size_t(ret));
+    }
+}
+
+void run_session(const settings& config, unsigned session, std::atomic<int64_t>& clock,
+                 session_result& result)
+{
+    int fd = connect_to(config.path);
+    if (fd < 0)
+        return;
+
+    std::mt19937_64 gen{session + 1};
+    std::string     request, pending;
+    char            number[24];
+    auto            append_number = [&](uint64_t value) {
+        auto end = hotel_processing::priv::format_decimal(number, value);
+        request.append(std::string_view(number, size_t(end - number)));
+    };
+
+    result.latencies.reserve(config.rounds);
+    for (size_t round = 0; round < config.rounds; ++round) {
+        request.clear();
+        for (size_t i = 0; i < config.books; ++i) {
+            request += "BOOK ";
+            append_number(uint64_t(clock.fetch_add(1, std::memory_order_relaxed)));
+            request += " h";
+            append_number(gen() % config.hotels);
+            request += ' ';
+            append_number(gen() % config.clients);
+            request += ' ';
+            append_number(gen() % 5 + 1);
+            request += '\n';
+        }
+        request += round % 2 ? "ROOMS h" : "CLIENTS h";
+        append_number(gen() % config.hotels);
+        request += '\n';
+
+        auto start = dt::steady_clock::now();
+        if (!send_all(fd, request.data(), request.size()) || !read_line(fd, pending)) {
+            ::close(fd);
+            return;
+        }
+        result.latencies.push_back(
+            uint64_t(dt::duration_cast<dt::nanoseconds>(dt::steady_clock::now() - start).count()));
+    }
+
+    ::close(fd);
+    result.ok = true;
+}
+
+void usage(const char* prog)
+{
+    std::cerr << "Usage: " << prog
+              << " [-c SESSIONS] [-n ROUNDS] [-b BOOKS] [-H HOTELS] [-C CLIENTS] SOCKET\n";
+}
+
+} // ::anonymous
+
+int main(int argc, char* argv[])
+{
+    settings config;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "-c") && i + 1 < argc) {
+            config.sessions = unsigned(std::max(1, std::atoi(argv[++i])));
+        } else if (!std::strcmp(argv[i], "-n") && i + 1 < argc) {
+            config.rounds = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "-b") && i + 1 < argc) {
+            config.books = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "-H") && i + 1 < argc) {
+            config.hotels = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (!std::strcmp(argv[i], "-C") && i + 1 < argc) {
+            config.clients = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else if (argv[i][0] != '-' && !config.path) {
+            config.path = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!config.path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::atomic<int64_t>        clock{1};
+    std::vector<session_result> results(config.sessions);
+    std::vector<std::thread>    threads;
+
+    auto start = dt::steady_clock::now();
+    for (unsigned i = 0; i < config.sessions; ++i)
+        threads.emplace_back(run_session, std::cref(config), i, std::ref(clock),
+                             std::ref(results[i]));
+    for (auto& thread : threads)
+        thread.join();
+    auto elapsed = dt::duration<double>(dt::steady_clock::now() - start).count();
+
+    hotel_processing::log2_histogram latency;
+    size_t                           rounds = 0;
+    for (auto const& result : results) {
+        if (!result.ok) {
+            std::cerr << "Session failed, is the server listening on " << config.path << "?\n";
+            return 1;
+        }
+        for (auto ns : result.latencies)
+            latency.record(ns);
+        rounds += result.latencies.size();
+    }
+
+    auto requests = rounds * (config.books + 1);
+    std::cout << fmt::format("sessions {}, rounds {}, requests {} in {:.3f} s: {:.0f} requests/s\n",
+                             config.sessions, rounds, requests, elapsed,
+                             double(requests) / elapsed);
+    hotel_processing::write_histogram(std::cout, "round trip", latency, 1.0, "ns");
+    return 0;
+}
@@ -1,43 +1,284 @@
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <vector>
+#include <cstdlib>
 
+#include <unistd.h>
+
+#include "batcher.h"
+#include "binlog.h"
 #include "hotels.h"
+#include "output.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "server.h"
 
-int main()
+static void usage(const char* prog)
 {
-    std::ios::sync_with_stdio(false);
-    std::cin.tie(nullptr);
+    std::cerr << "Usage: " << prog << " [-j THREADS] [-w WINDOWS] [-E ENGINE] [-e ERROR]\n"
+              << "       [-r SECONDS] [-A KIND] [-H] [-l SNAPSHOT] [-s SNAPSHOT] [-S]\n"
+              << "       [-L SOCKET | FILE]\n"
+              << "  -j, --threads THREADS   process hotels on THREADS shard workers\n"
+              << "  -w, --windows WINDOWS   comma separated time windows in seconds, queries are\n"
+              << "                          answered for each of them on the same line\n"
+              << "  -E, --engine ENGINE     cached, lazy or approx\n"
+              << "  -e, --estimate ERROR    estimate clients with the given relative error,\n"
+              << "                          selects approx engine\n"
+              << "  -r, --reorder SECONDS   accept bookings up to SECONDS older than the latest\n"
+              << "                          one in time order, current time never goes back\n"
+              << "  -A, --allocator KIND    heap, pool or arena: what hotels allocate from, heap\n"
+              << "                          by default and pool with -j or -L; arena never\n"
+              << "                          reuses freed memory, for bounded runs only\n"
+              << "  -H, --huge-pages        back pool and arena memory with huge pages\n"
+              << "  -l, --load SNAPSHOT     start from the saved context state, its windows are\n"
+              << "                          used\n"
+              << "  -s, --save SNAPSHOT     save the context state after processing\n"
+              << "  -S, --stats             print statistics to stderr on exit and on SIGUSR1,\n"
+              << "                          needs a build with ENABLE_STATS\n"
+              << "  -L, --listen SOCKET     serve request lines (no count) of many sessions on\n"
+              << "                          the Unix socket until SIGINT or SIGTERM\n"
+              << "Reads requests from FILE or standard input. Binary logs (see binlog_convert) and\n"
+              << "runs with snapshots or statistics are processed sequentially.\n";
+}
 
-    hotel_processing::context ctx;
+namespace {
 
-    size_t requests_count;
-    std::cin >> requests_count;
+// Set by SIGUSR1, the report is printed between batches
+volatile std::sig_atomic_t stats_requested = 0;
 
-    for (size_t i = 0; i < requests_count; ++i) {
-        std::string request_kind;
-        std::cin >> request_kind;
+void request_stats(int)
+{
+    stats_requested = 1;
+}
 
-        if (request_kind == "BOOK") {
-            hotel_processing::time_t time;
-            hotel_processing::client_id_t client;
-            hotel_processing::room_t rooms;
-            std::string hotel_name;
+// Set by SIGINT/SIGTERM in the server mode
+volatile std::sig_atomic_t stop_requested = 0;
 
-            std::cin >> time >> hotel_name >> client >> rooms;
+void request_stop(int)
+{
+    stop_requested = 1;
+}
 
-            ctx.book(time, hotel_name, client, rooms);
+template<typename Context>
+void print_stats(const Context& ctx)
+{
+    hotel_processing::write_stats(std::cerr, ctx.stats(), [&](hotel_processing::hotel_id_t id) {
+        return ctx.hotel_name(id);
+    });
+}
 
-        } else {
-            std::string hotel_name;
-            std::cin >> hotel_name;
+// Batches of the requests, answers go to the output, statistics are printed between batches
+template<typename Context>
+auto make_batcher(Context& ctx, hotel_processing::output_writer& out)
+{
+    auto on_batch = [&ctx, &out, windows = ctx.windows().size()](std::span<const size_t> answers) {
+        out.answers(answers, windows);
+        if (stats_requested) {
+            stats_requested = 0;
+            print_stats(ctx);
+        }
+    };
+    return hotel_processing::request_batcher{ctx, on_batch};
+}
+
+template<typename Context>
+void process(Context& ctx, std::string_view input, hotel_processing::output_writer& out)
+{
+    auto                             batch = make_batcher(ctx, out);
+    hotel_processing::request_parser parser{input};
+    hotel_processing::request        req;
+    size_t                           requests_count = parser.count();
+
+    for (size_t i = 0; i < requests_count && parser.next(req); ++i)
+        batch.add(req);
+}
+
+// Binary log records go to the context as is: hotel names are only looked up on first use
+template<typename Context>
+void replay(Context& ctx, const hotel_processing::binlog_reader& log,
+            hotel_processing::output_writer& out)
+{
+    auto                                     batch = make_batcher(ctx, out);
+    hotel_processing::binlog_hotels<Context> ids{ctx, log};
+    auto                                     time = log.base_time();
+
+    for (auto const& rec : log.records()) {
+        if (rec.hotel >= ids.size() && rec.kind() != hotel_processing::binlog_kind::time)
+            continue;
+        switch (rec.kind()) {
+            case hotel_processing::binlog_kind::book:
+                time += rec.delta();
+                batch.book({time, ids.book(rec.hotel), rec.client, rec.rooms});
+                break;
+            case hotel_processing::binlog_kind::clients:
+                batch.query(hotel_processing::query_kind::clients, ids.query(rec.hotel));
+                break;
+            case hotel_processing::binlog_kind::rooms:
+                batch.query(hotel_processing::query_kind::rooms, ids.query(rec.hotel));
+                break;
+            case hotel_processing::binlog_kind::time:
+                time = rec.time();
+                break;
+        }
+    }
+}
+
+} // ::anonymous
 
-            if (request_kind == "CLIENTS") {
-                std::cout << ctx.clients(hotel_name) << '\n';
-            } else if (request_kind == "ROOMS") {
-                std::cout << ctx.rooms(hotel_name) << '\n';
+int main(int argc, char* argv[])
+{
+    std::ios::sync_with_stdio(false);
+    std::cin.tie(nullptr);
+
+    const char*                           path      = nullptr;
+    const char*                           load_path = nullptr;
+    const char*                           save_path = nullptr;
+    const char*                           listen    = nullptr;
+    bool                                  stats     = false;
+    unsigned                              threads   = 1;
+    std::vector<hotel_processing::time_t> windows;
+    hotel_processing::engine_kind         engine    = hotel_processing::DEFAULT_ENGINE;
+    hotel_processing::engine_options      options;
+    hotel_processing::memory_options      memory;
+    bool                                  allocator = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if ((!std::strcmp(argv[i], "-j") || !std::strcmp(argv[i], "--threads")) && i + 1 < argc) {
+            threads = unsigned(std::strtoul(argv[++i], nullptr, 10));
+        } else if ((!std::strcmp(argv[i], "-w") || !std::strcmp(argv[i], "--windows")) &&
+                   i + 1 < argc) {
+            for (char* cur = argv[++i]; *cur;) {
+                auto window = std::strtoll(cur, &cur, 10);
+                if (window <= 0 || (*cur && *cur != ',')) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                windows.push_back(window);
+                if (*cur)
+                    ++cur;
+            }
+        } else if ((!std::strcmp(argv[i], "-e") || !std::strcmp(argv[i], "--estimate")) &&
+                   i + 1 < argc) {
+            engine                = hotel_processing::engine_kind::approx;
+            options.clients_error = std::strtod(argv[++i], nullptr);
+            if (options.clients_error <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if ((!std::strcmp(argv[i], "-E") || !std::strcmp(argv[i], "--engine")) &&
+                   i + 1 < argc) {
+            auto kind = hotel_processing::parse_engine(argv[++i]);
+            if (!kind) {
+                usage(argv[0]);
+                return 1;
             }
+            engine = *kind;
+        } else if ((!std::strcmp(argv[i], "-r") || !std::strcmp(argv[i], "--reorder")) &&
+                   i + 1 < argc) {
+            options.reorder = std::strtoll(argv[++i], nullptr, 10);
+            if (options.reorder < 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if ((!std::strcmp(argv[i], "-A") || !std::strcmp(argv[i], "--allocator")) &&
+                   i + 1 < argc) {
+            auto kind = hotel_processing::parse_allocator(argv[++i]);
+            if (!kind) {
+                usage(argv[0]);
+                return 1;
+            }
+            memory.allocator = *kind;
+            allocator        = true;
+        } else if (!std::strcmp(argv[i], "-H") || !std::strcmp(argv[i], "--huge-pages")) {
+            memory.huge_pages = true;
+        } else if ((!std::strcmp(argv[i], "-l") || !std::strcmp(argv[i], "--load")) &&
+                   i + 1 < argc) {
+            load_path = argv[++i];
+        } else if ((!std::strcmp(argv[i], "-s") || !std::strcmp(argv[i], "--save")) &&
+                   i + 1 < argc) {
+            save_path = argv[++i];
+        } else if ((!std::strcmp(argv[i], "-L") || !std::strcmp(argv[i], "--listen")) &&
+                   i + 1 < argc) {
+            listen = argv[++i];
+        } else if (!std::strcmp(argv[i], "-S") || !std::strcmp(argv[i], "--stats")) {
+            stats = true;
+        } else if (argv[i][0] == '-' && argv[i][1]) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            path = argv[i];
         }
+    }
+
+    if (stats)
+        std::signal(SIGUSR1, request_stats);
+
+    // Long running modes reuse freed blocks of their hotels
+    if (!allocator && (listen || threads > 1))
+        memory.allocator = hotel_processing::allocator_kind::pool;
 
+    hotel_processing::input_buffer input;
+    if (!listen && !(path ? input.open(path) : input.open(STDIN_FILENO))) {
+        std::cerr << "Can't read input\n";
+        return 1;
     }
 
-    return 0;
+    if (windows.empty())
+        windows.push_back(hotel_processing::TIME_WINDOW);
+
+    hotel_processing::binlog_reader log;
+    bool                            binary = hotel_processing::is_binlog(input.data());
+    if (binary && !log.open(input.data())) {
+        std::cerr << "Malformed binary log\n";
+        return 1;
+    }
+
+    hotel_processing::output_writer out{STDOUT_FILENO};
+    if (threads > 1 && !binary && !load_path && !save_path && !stats && !listen) {
+        hotel_processing::process_sharded(input.data(), threads, windows, engine, options, out,
+                                          memory);
+        if (!out.ok()) {
+            std::cerr << "Can't write output\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    auto any = hotel_processing::make_context(engine, windows, options, memory);
+    return std::visit([&](auto& ctx) {
+        if (load_path && !ctx.load(load_path)) {
+            std::cerr << "Can't load snapshot\n";
+            return 1;
+        }
+        if (listen) {
+            std::signal(SIGINT, request_stop);
+            std::signal(SIGTERM, request_stop);
+            auto poll = [&ctx] {
+                if (stats_requested) {
+                    stats_requested = 0;
+                    print_stats(ctx);
+                }
+            };
+            if (!hotel_processing::serve(ctx, listen, stop_requested, poll)) {
+                std::cerr << "Can't listen on the socket\n";
+                return 1;
+            }
+        } else if (binary) {
+            replay(ctx, log, out);
+        } else {
+            process(ctx, input.data(), out);
+        }
+        if (!out.flush()) {
+            std::cerr << "Can't write output\n";
+            return 1;
+        }
+        if (stats)
+            print_stats(ctx);
+        if (save_path && !ctx.save(save_path)) {
+            std::cerr << "Can't save snapshot\n";
+            return 1;
+        }
+        return 0;
+    }, any);
 }
@@ -0,0 +1,143 @@
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define HOTEL_HAVE_MMAP 1
+#endif
+
+#include "memory.h"
+
+namespace hotel_processing {
+
+std::optional<allocator_kind> parse_allocator(std::string_view name)
+{
+    if (name == "heap")
+        return allocator_kind::heap;
+    if (name == "pool")
+        return allocator_kind::pool;
+    if (name == "arena")
+        return allocator_kind::arena;
+    return std::nullopt;
+}
+
+namespace priv {
+
+#ifdef HOTEL_HAVE_MMAP
+
+namespace {
+
+constexpr size_t PAGE = 4096;
+
+size_t mapping_size(size_t bytes)
+{
+    auto page = bytes >= huge_page_resource::HUGE_PAGE ? huge_page_resource::HUGE_PAGE : PAGE;
+    return (bytes + page - 1) / page * page;
+}
+
+} // ::anonymous
+
+void* huge_page_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    auto size = mapping_size(bytes);
+    if (alignment > PAGE)
+        throw std::bad_alloc{};
+    if (size < HUGE_PAGE) {
+        auto ptr =
+            ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            throw std::bad_alloc{};
+        return ptr;
+    }
+
+    // Map a huge page more and trim both ends to the alignment
+    auto extra = size + HUGE_PAGE;
+    auto raw = ::mmap(nullptr, extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+        throw std::bad_alloc{};
+    auto addr  = reinterpret_cast<uintptr_t>(raw);
+    auto start = (addr + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+    if (start > addr)
+        ::munmap(raw, start - addr);
+    if (auto tail = addr + extra - (start + size))
+        ::munmap(reinterpret_cast<void*>(start + size), tail);
+
+    auto ptr = reinterpret_cast<void*>(start);
+#ifdef MADV_HUGEPAGE
+    ::madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    return ptr;
+}
+
+void huge_page_resource::do_deallocate(void* ptr, size_t bytes, size_t)
+{
+    ::munmap(ptr, mapping_size(bytes));
+}
+
+#else
+
+void* huge_page_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void huge_page_resource::do_deallocate(void* ptr, size_t bytes, size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+}
+
+#endif
+
+} // ::priv
+
+struct context_memory::state
+{
+    memory_options                                         options;
+    priv::huge_page_resource                               huge_pages;
+    std::optional<std::pmr::unsynchronized_pool_resource> pool;
+    std::optional<std::pmr::monotonic_buffer_resource>     arena;
+    std::pmr::memory_resource*                             resource{};
+};
+
+context_memory::context_memory(memory_options options) : m_state(std::make_unique<state>())
+{
+    m_state->options = options;
+
+    std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+    if (options.huge_pages)
+        upstream = &m_state->huge_pages;
+    switch (options.allocator) {
+        case allocator_kind::heap:
+            m_state->resource = std::pmr::new_delete_resource();
+            break;
+        case allocator_kind::pool:
+            m_state->resource = &m_state->pool.emplace(upstream);
+            break;
+        case allocator_kind::arena:
+            // Chunks start at the huge page size and grow from there
+            m_state->resource =
+                &m_state->arena.emplace(priv::huge_page_resource::HUGE_PAGE, upstream);
+            break;
+    }
+}
+
+context_memory::~context_memory() = default;
+
+void context_memory::reset()
+{
+    if (m_state->pool)
+        m_state->pool->release();
+    if (m_state->arena)
+        m_state->arena->release();
+}
+
+std::pmr::memory_resource* context_memory::resource() const
+{
+    return m_state->resource;
+}
+
+memory_options context_memory::options() const
+{
+    return m_state->options;
+}
+
+} // ::hotel_processing
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+namespace hotel_processing {
+
+enum class allocator_kind : uint8_t
+{
+    // global operator new/delete
+    heap,
+    // size-class pools, freed blocks are reused by the context
+    pool,
+    // bump allocation, freed blocks are only reclaimed with the context or its clear(): for
+    // bounded and batch runs, booking logs growing in a long run leave their old buffers behind
+    arena,
+};
+
+// Where a context allocates per-hotel storage from
+struct memory_options
+{
+    allocator_kind allocator{allocator_kind::heap};
+    // back pool and arena chunks with transparent huge pages, where available
+    bool huge_pages{};
+};
+
+// Allocator by its name: "heap", "pool" or "arena"
+std::optional<allocator_kind> parse_allocator(std::string_view name);
+
+namespace priv {
+
+/**
+ * The huge_page_resource class
+ *
+ * Upstream of the pool and arena resources: every allocation is its own anonymous mapping, and
+ * the ones of at least HUGE_PAGE bytes are aligned to it and advised to be backed by transparent
+ * huge pages. Falls back to the heap where there's no mmap(2).
+ */
+class huge_page_resource : public std::pmr::memory_resource
+{
+public:
+    static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void  do_deallocate(void* ptr, size_t bytes, size_t alignment) override;
+    bool  do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+/**
+ * The pmr_array class
+ *
+ * Fixed size array of trivial values in a memory resource, elements are left uninitialized. It
+ * replaces std::unique_ptr<T[]> in the containers that manage their capacity themselves.
+ */
+template<typename T>
+class pmr_array
+{
+public:
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+    pmr_array() = default;
+
+    pmr_array(std::pmr::memory_resource* memory, size_t size) :
+        m_data(static_cast<T*>(memory->allocate(size * sizeof(T), alignof(T)))),
+        m_size(size),
+        m_memory(memory)
+    {
+    }
+
+    pmr_array(pmr_array&& other) noexcept :
+        m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_memory(other.m_memory)
+    {
+    }
+
+    pmr_array& operator=(pmr_array&& other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            m_data   = std::exchange(other.m_data, nullptr);
+            m_size   = std::exchange(other.m_size, 0);
+            m_memory = other.m_memory;
+        }
+        return *this;
+    }
+
+    ~pmr_array() { reset(); }
+
+    void reset()
+    {
+        if (m_data)
+            m_memory->deallocate(m_data, m_size * sizeof(T), alignof(T));
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    T*     get() const { return m_data; }
+    size_t size() const { return m_size; }
+    T&     operator[](size_t idx) const { return m_data[idx]; }
+
+    explicit operator bool() const { return m_data != nullptr; }
+
+private:
+    T*                         m_data{};
+    size_t                     m_size{};
+    std::pmr::memory_resource* m_memory{};
+};
+
+} // ::priv
+
+/**
+ * The context_memory class
+ *
+ * Memory resource of a context, per-hotel containers allocate from it. Pool and arena memory is
+ * released in large chunks by reset() or when the context goes, instead of one free() per
+ * container block. The resources are single-threaded, like the context.
+ *
+ * Move assignment swaps the resources: the moved-from owner keeps the old one alive until its
+ * containers are destroyed, so members allocated from it may be assigned in any order.
+ */
+class context_memory
+{
+public:
+    explicit context_memory(memory_options options = {});
+    ~context_memory();
+
+    context_memory(context_memory&& other) noexcept = default;
+
+    context_memory& operator=(context_memory&& other) noexcept
+    {
+        std::swap(m_state, other.m_state);
+        return *this;
+    }
+
+    std::pmr::memory_resource* resource() const;
+    memory_options             options() const;
+
+    // Release all pool and arena memory at once, nothing allocated from the resource may be in
+    // use. Heap blocks are freed by their owners, so it's a no-op for the heap.
+    void reset();
+
+private:
+    struct state;
+    std::unique_ptr<state> m_state;
+};
+
+} // ::hotel_processing
@@ -0,0 +1,56 @@
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "output.h"
+
+namespace hotel_processing {
+
+output_writer::output_writer(int fd)
+    : m_buffer(std::make_unique<char[]>(CAPACITY)),
+      m_pos(m_buffer.get()),
+      m_end(m_buffer.get() + CAPACITY),
+      m_fd(fd)
+{
+}
+
+output_writer::output_writer(std::ostream& out)
+    : m_buffer(std::make_unique<char[]>(CAPACITY)),
+      m_pos(m_buffer.get()),
+      m_end(m_buffer.get() + CAPACITY),
+      m_out(&out)
+{
+}
+
+output_writer::~output_writer()
+{
+    flush();
+}
+
+bool output_writer::flush()
+{
+    auto data = m_buffer.get();
+    auto size = size_t(m_pos - data);
+    m_pos     = data;
+    if (!m_ok || !size)
+        return m_ok;
+
+    if (m_out) {
+        m_out->write(data, std::streamsize(size));
+        return m_ok = bool(*m_out);
+    }
+
+    while (size) {
+        auto ret = ::write(m_fd, data, size);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return m_ok = false;
+        }
+        data += ret;
+        size -= size_t(ret);
+    }
+    return true;
+}
+
+} // ::hotel_processing
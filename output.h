@@ -0,0 +1,150 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <span>
+
+namespace hotel_processing {
+
+namespace priv {
+
+// "00", "01", ... "99"
+inline constexpr char DIGIT_PAIRS[] = "00010203040506070809"
+                                      "10111213141516171819"
+                                      "20212223242526272829"
+                                      "30313233343536373839"
+                                      "40414243444546474849"
+                                      "50515253545556575859"
+                                      "60616263646566676869"
+                                      "70717273747576777879"
+                                      "80818283848586878889"
+                                      "90919293949596979899";
+
+inline unsigned decimal_digits(uint64_t value)
+{
+    static constexpr uint64_t POWERS[] = {
+        0,
+        10,
+        100,
+        1000,
+        10000,
+        100000,
+        1000000,
+        10000000,
+        100000000,
+        1000000000,
+        10000000000,
+        100000000000,
+        1000000000000,
+        10000000000000,
+        100000000000000,
+        1000000000000000,
+        10000000000000000,
+        100000000000000000,
+        1000000000000000000,
+        10000000000000000000u,
+    };
+    // bit width * log10(2) is the count or one less
+    unsigned digits = unsigned(std::bit_width(value | 1) * 1233) >> 12;
+    return digits + (value >= POWERS[digits]);
+}
+
+/**
+ * Decimal representation of the value, two digits per step
+ *
+ * @return end of the written digits, at most 20 chars are written
+ */
+inline char* format_decimal(char* out, uint64_t value)
+{
+    auto end = out + decimal_digits(value);
+    out      = end;
+    while (value >= 100) {
+        out -= 2;
+        std::memcpy(out, DIGIT_PAIRS + value % 100 * 2, 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        out -= 2;
+        std::memcpy(out, DIGIT_PAIRS + value * 2, 2);
+    } else {
+        *--out = char('0' + value);
+    }
+    return end;
+}
+
+} // ::priv
+
+/**
+ * The output_writer class
+ *
+ * Buffered output of query answers: numbers are formatted straight into a CAPACITY buffer that
+ * goes to the file descriptor with write(2) (or to the stream) only when it's full or flushed.
+ * Destructor flushes what's left.
+ */
+class output_writer
+{
+public:
+    static constexpr size_t CAPACITY = 64 * 1024;
+    // The longest item: 64-bit number and a separator
+    static constexpr size_t MAX_ITEM = 21;
+
+    explicit output_writer(int fd);
+    explicit output_writer(std::ostream& out);
+    ~output_writer();
+
+    output_writer(const output_writer&)            = delete;
+    output_writer& operator=(const output_writer&) = delete;
+
+    void number(uint64_t value)
+    {
+        reserve();
+        m_pos = priv::format_decimal(m_pos, value);
+    }
+
+    void put(char ch)
+    {
+        reserve();
+        *m_pos++ = ch;
+    }
+
+    /**
+     * Query answers, every `columns` values (the answers of one query for all windows) form a
+     * line
+     */
+    void answers(std::span<const size_t> values, size_t columns)
+    {
+        for (size_t i = 0; i < values.size(); ++i) {
+            reserve();
+            m_pos    = priv::format_decimal(m_pos, values[i]);
+            *m_pos++ = (i + 1) % columns ? ' ' : '\n';
+        }
+    }
+
+    /**
+     * Write out the buffer
+     * @return false if this or any previous write failed
+     */
+    bool flush();
+
+    bool ok() const { return m_ok; }
+
+private:
+    void reserve()
+    {
+        if (size_t(m_end - m_pos) < MAX_ITEM)
+            flush();
+    }
+
+private:
+    std::unique_ptr<char[]> m_buffer;
+    char*                   m_pos;
+    char*                   m_end;
+    int                     m_fd{-1};
+    std::ostream*           m_out{};
+    bool                    m_ok{true};
+};
+
+} // ::hotel_processing
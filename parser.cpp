@@ -0,0 +1,200 @@
+#include <bit>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "parser.h"
+
+namespace hotel_processing {
+
+namespace {
+
+inline bool is_space(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+inline bool is_digit(char ch)
+{
+    return unsigned(ch - '0') < 10;
+}
+
+// All 8 bytes are ASCII digits
+inline bool all_digits(uint64_t chunk)
+{
+    return ((chunk & 0xF0F0F0F0F0F0F0F0) |
+            (((chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+// Convert 8 ASCII digits (little-endian load) to the number
+inline uint32_t parse_eight_digits(uint64_t chunk)
+{
+    chunk -= 0x3030303030303030;
+    chunk = (chunk * 10) + (chunk >> 8);
+    chunk = (((chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+             (((chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+    return uint32_t(chunk);
+}
+
+} // ::anonymous
+
+input_buffer::~input_buffer()
+{
+    reset();
+}
+
+void input_buffer::reset()
+{
+    if (m_map) {
+        ::munmap(m_map, m_map_size);
+    }
+    m_map      = nullptr;
+    m_map_size = 0;
+    m_data     = nullptr;
+    m_size     = 0;
+    m_storage.clear();
+}
+
+bool input_buffer::open(const char* path)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    auto ret = open(fd);
+    ::close(fd);
+    return ret;
+}
+
+bool input_buffer::open(int fd)
+{
+    reset();
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+        return false;
+
+    if (S_ISREG(st.st_mode)) {
+        auto offset = ::lseek(fd, 0, SEEK_CUR);
+        if (offset < 0)
+            offset = 0;
+        if (st.st_size <= offset)
+            return true;
+
+        auto map = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            ::madvise(map, size_t(st.st_size), MADV_SEQUENTIAL);
+            m_map      = map;
+            m_map_size = size_t(st.st_size);
+            m_data     = static_cast<const char*>(map) + offset;
+            m_size     = size_t(st.st_size - offset);
+            return true;
+        }
+    }
+
+    // Pipes and other streams: read everything
+    char buf[64 * 1024];
+    while (true) {
+        auto ret = ::read(fd, buf, sizeof(buf));
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (ret == 0)
+            break;
+        m_storage.append(buf, size_t(ret));
+    }
+
+    m_data = m_storage.data();
+    m_size = m_storage.size();
+    return true;
+}
+
+size_t request_parser::count()
+{
+    return parse_uint();
+}
+
+bool request_parser::next(request& req)
+{
+    auto kind = token();
+    if (kind.empty())
+        return false;
+
+    if (kind == "BOOK") {
+        req.kind   = request_kind::book;
+        req.time   = parse_int();
+        req.hotel  = token();
+        req.client = client_id_t(parse_uint());
+        req.rooms  = room_t(parse_uint());
+    } else {
+        req.hotel = token();
+        if (kind == "CLIENTS") {
+            req.kind = request_kind::clients;
+        } else if (kind == "ROOMS") {
+            req.kind = request_kind::rooms;
+        } else {
+            req.kind = request_kind::unknown;
+        }
+    }
+
+    return true;
+}
+
+std::string_view request_parser::token()
+{
+    while (m_cur != m_end && is_space(*m_cur))
+        ++m_cur;
+
+    auto start = m_cur;
+    while (m_cur != m_end && !is_space(*m_cur))
+        ++m_cur;
+
+    return {start, size_t(m_cur - start)};
+}
+
+uint64_t request_parser::parse_uint()
+{
+    while (m_cur != m_end && is_space(*m_cur))
+        ++m_cur;
+
+    uint64_t value = 0;
+
+    if constexpr (std::endian::native == std::endian::little) {
+        while (m_end - m_cur >= 8) {
+            uint64_t chunk;
+            std::memcpy(&chunk, m_cur, sizeof(chunk));
+            if (!all_digits(chunk))
+                break;
+            value = value * 100'000'000 + parse_eight_digits(chunk);
+            m_cur += 8;
+        }
+    }
+
+    while (m_cur != m_end && is_digit(*m_cur)) {
+        value = value * 10 + unsigned(*m_cur - '0');
+        ++m_cur;
+    }
+
+    return value;
+}
+
+int64_t request_parser::parse_int()
+{
+    while (m_cur != m_end && is_space(*m_cur))
+        ++m_cur;
+
+    bool negative = false;
+    if (m_cur != m_end && (*m_cur == '-' || *m_cur == '+')) {
+        negative = *m_cur == '-';
+        ++m_cur;
+    }
+
+    auto value = parse_uint();
+    return negative ? int64_t(0 - value) : int64_t(value);
+}
+
+} // ::hotel_processing
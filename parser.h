@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "hotels.h"
+
+namespace hotel_processing {
+
+enum class request_kind : uint8_t
+{
+    book,
+    clients,
+    rooms,
+    unknown,
+};
+
+/**
+ * Single parsed request.
+ *
+ * `hotel` points directly into the parsed input and stays valid while the input lives.
+ */
+struct request
+{
+    request_kind     kind{request_kind::unknown};
+    time_t           time{};
+    std::string_view hotel;
+    client_id_t      client{};
+    room_t           rooms{};
+};
+
+/**
+ * The input_buffer class
+ *
+ * Keeps the whole input in memory: regular files are mmapped, anything else (pipes, terminals)
+ * is read into an owned buffer.
+ */
+class input_buffer
+{
+public:
+    input_buffer() = default;
+    ~input_buffer();
+
+    input_buffer(const input_buffer&)            = delete;
+    input_buffer& operator=(const input_buffer&) = delete;
+
+    /**
+     * Open file by path
+     * @return false on failure
+     */
+    bool open(const char* path);
+
+    /**
+     * Use already opened descriptor, reading starts from the current file position
+     * @return false on failure
+     */
+    bool open(int fd);
+
+    std::string_view data() const { return {m_data, m_size}; }
+
+private:
+    void reset();
+
+private:
+    const char* m_data{};
+    size_t      m_size{};
+    // mmapped region, if any
+    void*       m_map{};
+    size_t      m_map_size{};
+    // fallback storage for non-mmappable inputs
+    std::string m_storage;
+};
+
+/**
+ * The request_parser class
+ *
+ * Tokenizes input in place, without any allocations. Input format is the same as main.cpp reads:
+ * requests count followed by the requests:
+ *
+ *     BOOK time hotel_name client_id room_count
+ *     CLIENTS hotel_name
+ *     ROOMS hotel_name
+ */
+class request_parser
+{
+public:
+    explicit request_parser(std::string_view input) :
+        m_cur(input.data()), m_end(input.data() + input.size())
+    {
+    }
+
+    /**
+     * Parse requests count header
+     */
+    size_t count();
+
+    /**
+     * Parse next request
+     * @return false on the end of input
+     */
+    bool next(request& req);
+
+    /**
+     * Unparsed rest of the input
+     */
+    std::string_view rest() const { return {m_cur, size_t(m_end - m_cur)}; }
+
+private:
+    std::string_view token();
+    uint64_t         parse_uint();
+    int64_t          parse_int();
+
+private:
+    const char* m_cur;
+    const char* m_end;
+};
+
+} // ::hotel_processing
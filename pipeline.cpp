@@ -0,0 +1,207 @@
+#include <condition_variable>
+#include <deque>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+#include "hotels.h"
+#include "parser.h"
+#include "pipeline.h"
+
+namespace hotel_processing {
+
+namespace {
+
+// Requests per batch
+constexpr size_t BATCH_SIZE = 16 * 1024;
+// Batches in flight, limits memory when output is slower than input
+constexpr ptrdiff_t MAX_BATCHES = 16;
+
+struct shard_op
+{
+    request_kind     kind;
+    time_t           time; // booking time
+    time_t           now;  // current stream time
+    std::string_view hotel;
+    client_id_t      client;
+    room_t           rooms;
+    uint32_t         answer; // first answer slot for queries
+};
+
+struct batch
+{
+    explicit batch(unsigned shards) : ops(shards), done(shards) {}
+
+    std::vector<std::vector<shard_op>> ops; // per shard
+    std::vector<size_t>                answers;
+    std::latch                         done;
+};
+
+using batch_ptr = std::shared_ptr<batch>;
+
+/**
+ * The blocking_queue struct
+ *
+ * simple structure to pass batches between threads
+ */
+template<typename T>
+struct blocking_queue
+{
+    std::mutex              m;
+    std::condition_variable cv;
+    std::deque<T>           q;
+
+    void push(T value)
+    {
+        std::unique_lock<std::mutex> lock{m};
+        q.push_back(std::move(value));
+        lock.unlock();
+        cv.notify_one();
+    }
+
+    T pop()
+    {
+        std::unique_lock<std::mutex> lock{m};
+        cv.wait(lock, [this] {
+            return !q.empty();
+        });
+        auto value = std::move(q.front());
+        q.pop_front();
+        return value;
+    }
+};
+
+template<typename Context>
+void shard_loop(Context& ctx, unsigned shard, std::span<const time_t> windows,
+                blocking_queue<batch_ptr>* queue)
+{
+    while (auto b = queue->pop()) {
+        for (auto const& op : b->ops[shard]) {
+            switch (op.kind) {
+                case request_kind::book:
+                    // with reorder tolerance late bookings are placed by the stream time
+                    ctx.set_time(op.now);
+                    ctx.book(op.time, op.hotel, op.client, op.rooms);
+                    break;
+                case request_kind::clients:
+                    ctx.set_time(op.now);
+                    for (size_t w = 0; w < windows.size(); ++w)
+                        b->answers[op.answer + w] = ctx.clients(op.hotel, windows[w]);
+                    break;
+                case request_kind::rooms:
+                    ctx.set_time(op.now);
+                    for (size_t w = 0; w < windows.size(); ++w)
+                        b->answers[op.answer + w] = ctx.rooms(op.hotel, windows[w]);
+                    break;
+                case request_kind::unknown:
+                    break;
+            }
+        }
+        b->done.count_down();
+    }
+}
+
+void shard_worker(unsigned shard, std::span<const time_t> windows, engine_kind engine,
+                  engine_options options, memory_options memory, blocking_queue<batch_ptr>* queue)
+{
+    auto any = make_context(engine, {windows.begin(), windows.end()}, options, memory);
+    std::visit([&](auto& ctx) {
+        shard_loop(ctx, shard, windows, queue);
+    }, any);
+}
+
+void merger(size_t windows, blocking_queue<batch_ptr>* queue,
+            std::counting_semaphore<MAX_BATCHES>* slots, output_writer* out)
+{
+    while (auto b = queue->pop()) {
+        b->done.wait();
+        out->answers(b->answers, windows);
+        slots->release();
+    }
+    out->flush();
+}
+
+} // ::anonymous
+
+void process_sharded(std::string_view input, unsigned shards, std::span<const time_t> windows,
+                     engine_kind engine, engine_options options, output_writer& out,
+                     memory_options memory)
+{
+    std::vector<blocking_queue<batch_ptr>> shard_queues(shards);
+    blocking_queue<batch_ptr>              merge_queue;
+    std::counting_semaphore<MAX_BATCHES>   slots{MAX_BATCHES};
+    std::vector<std::thread>               workers;
+
+    workers.reserve(shards + 1);
+    for (unsigned i = 0; i < shards; ++i) {
+        workers.emplace_back(shard_worker, i, windows, engine, options, memory, &shard_queues[i]);
+    }
+    workers.emplace_back(merger, windows.size(), &merge_queue, &slots, &out);
+
+    request_parser parser{input};
+    request        req;
+    time_t         current_time{};
+    size_t         requests_count = parser.count();
+    size_t         processed      = 0;
+    bool           eof            = false;
+
+    while (!eof && processed < requests_count) {
+        slots.acquire();
+
+        auto b = std::make_shared<batch>(shards);
+        for (auto& ops : b->ops) {
+            ops.reserve(BATCH_SIZE / shards);
+        }
+
+        for (size_t i = 0; i < BATCH_SIZE && processed < requests_count; ++i, ++processed) {
+            if (!parser.next(req)) {
+                eof = true;
+                break;
+            }
+
+            shard_op op{req.kind, req.time, current_time, req.hotel, req.client, req.rooms, 0};
+            switch (req.kind) {
+                case request_kind::book:
+                    current_time = options.reorder ? std::max(current_time, req.time) : req.time;
+                    op.now       = current_time;
+                    break;
+                case request_kind::clients:
+                case request_kind::rooms:
+                    op.answer = uint32_t(b->answers.size());
+                    b->answers.resize(b->answers.size() + windows.size());
+                    break;
+                case request_kind::unknown:
+                    continue;
+            }
+
+            b->ops[priv::name_hash{}(req.hotel) % shards].push_back(op);
+        }
+
+        for (unsigned i = 0; i < shards; ++i) {
+            shard_queues[i].push(b);
+        }
+        merge_queue.push(std::move(b));
+    }
+
+    for (auto& queue : shard_queues) {
+        queue.push(nullptr);
+    }
+    merge_queue.push(nullptr);
+
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void process_sharded(std::string_view input, unsigned shards, std::span<const time_t> windows,
+                     engine_kind engine, engine_options options, std::ostream& out,
+                     memory_options memory)
+{
+    output_writer writer{out};
+    process_sharded(input, shards, windows, engine, options, writer, memory);
+}
+
+} // ::hotel_processing
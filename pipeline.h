@@ -0,0 +1,40 @@
+#pragma once
+
+#include <ostream>
+#include <span>
+#include <string_view>
+
+#include "hotels.h"
+#include "output.h"
+
+namespace hotel_processing {
+
+/**
+ * Multi-threaded sharded processing
+ *
+ * The calling thread parses input and routes requests by hotel name to `shards` workers, each one
+ * owning its own context with a subset of hotels. Queries carry the current time of the whole
+ * stream, so shards evict exactly as a single context would. Merge thread writes CLIENTS/ROOMS
+ * answers in the original request order, output is byte for byte the same as sequential one for
+ * streams with non-decreasing time or with reorder tolerance. Otherwise, when time goes
+ * backwards, results depend on when expired bookings were reclaimed, and that differs between
+ * shards and a single context.
+ *
+ * @param input        requests in the main.cpp format
+ * @param shards       worker threads count, must be positive
+ * @param windows      context windows, every query is answered for all of them on the same line
+ * @param engine       engine of the shard contexts
+ * @param options      engine settings
+ * @param out          answers sink, it's flushed before return
+ * @param memory       allocator of every shard context
+ */
+void process_sharded(std::string_view input, unsigned shards, std::span<const time_t> windows,
+                     engine_kind engine, engine_options options, output_writer& out,
+                     memory_options memory = {});
+
+// Same as above with answers written to the stream
+void process_sharded(std::string_view input, unsigned shards, std::span<const time_t> windows,
+                     engine_kind engine, engine_options options, std::ostream& out,
+                     memory_options memory = {});
+
+} // ::hotel_processing
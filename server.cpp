@@ -0,0 +1,378 @@
+#include <cerrno>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "parser.h"
+#include "server.h"
+
+namespace hotel_processing {
+
+namespace {
+
+constexpr int MAX_EVENTS = 256;
+
+class file_descriptor
+{
+public:
+    explicit file_descriptor(int fd) : m_fd(fd) {}
+    ~file_descriptor()
+    {
+        if (m_fd >= 0)
+            ::close(m_fd);
+    }
+
+    file_descriptor(const file_descriptor&)            = delete;
+    file_descriptor& operator=(const file_descriptor&) = delete;
+
+    operator int() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+/**
+ * The session_task class
+ *
+ * Coroutine of a session: it starts running on creation and stays suspended at the end until
+ * the owner destroys it.
+ */
+class session_task
+{
+public:
+    struct promise_type
+    {
+        session_task get_return_object()
+        {
+            return session_task{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+
+        std::suspend_never  initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { std::terminate(); }
+    };
+
+    session_task() = default;
+    session_task(session_task&& other) noexcept : m_handle(std::exchange(other.m_handle, {})) {}
+
+    session_task& operator=(session_task&& other) noexcept
+    {
+        std::swap(m_handle, other.m_handle);
+        return *this;
+    }
+
+    ~session_task()
+    {
+        if (m_handle)
+            m_handle.destroy();
+    }
+
+    bool done() const { return !m_handle || m_handle.done(); }
+
+private:
+    explicit session_task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+// Socket of a session and the coroutine waiting for its events
+struct connection
+{
+    explicit connection(int fd) : socket(fd) {}
+
+    file_descriptor         socket;
+    std::coroutine_handle<> waiter;
+    session_task            task;
+    // queued on the ready list, a socket event may resume the session before its turn comes
+    bool                    in_ready{};
+};
+
+// Suspends the session until the next event of its socket, they are edge-triggered
+struct socket_event
+{
+    connection& conn;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) noexcept { conn.waiter = handle; }
+    void await_resume() noexcept { conn.waiter = {}; }
+};
+
+// Suspends the session until the event loop resumes the ready ones
+struct reschedule
+{
+    connection&               conn;
+    std::vector<connection*>& ready;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        conn.waiter = handle;
+        if (!conn.in_ready) {
+            conn.in_ready = true;
+            ready.push_back(&conn);
+        }
+    }
+    void await_resume() noexcept { conn.waiter = {}; }
+};
+
+// Same layout as output_writer::answers()
+void append_answers(std::string& out, std::span<const size_t> values, size_t columns)
+{
+    auto size = out.size();
+    out.resize(size + values.size() * output_writer::MAX_ITEM);
+    auto pos = out.data() + size;
+    for (size_t i = 0; i < values.size(); ++i) {
+        pos    = priv::format_decimal(pos, values[i]);
+        *pos++ = (i + 1) % columns ? ' ' : '\n';
+    }
+    out.resize(size_t(pos - out.data()));
+}
+
+/**
+ * The request_executor class
+ *
+ * Applies request lines to the context: consecutive BOOKs and consecutive queries go in
+ * batches, like main.cpp does. Shared by all sessions of the server.
+ */
+template<typename Context>
+class request_executor
+{
+public:
+    explicit request_executor(Context& ctx) : m_ctx(ctx), m_windows(ctx.windows().size()) {}
+
+    // Apply the complete request lines, answers are appended to `out`
+    void execute(std::string_view lines, std::string& out)
+    {
+        request_parser parser{lines};
+        request        req;
+        while (parser.next(req)) {
+            switch (req.kind) {
+                case request_kind::book:
+                    if (!m_queries.empty())
+                        flush_queries(out);
+                    m_books.push_back({req.time, m_ctx.intern(req.hotel), req.client, req.rooms});
+                    break;
+                case request_kind::clients:
+                case request_kind::rooms: {
+                    if (!m_books.empty())
+                        flush_books();
+                    auto hotel = m_ctx.find(req.hotel);
+                    auto kind  = req.kind == request_kind::clients ? query_kind::clients
+                                                                   : query_kind::rooms;
+                    for (uint32_t w = 0; w < m_windows; ++w)
+                        m_queries.push_back({kind, hotel ? *hotel : INVALID_HOTEL, w});
+                    break;
+                }
+                case request_kind::unknown:
+                    break;
+            }
+        }
+        flush_books();
+        flush_queries(out);
+    }
+
+private:
+    void flush_books()
+    {
+        m_ctx.book_batch(m_books);
+        m_books.clear();
+    }
+
+    void flush_queries(std::string& out)
+    {
+        m_answers.resize(m_queries.size());
+        m_ctx.query_batch(m_queries, m_answers);
+        append_answers(out, m_answers, m_windows);
+        m_queries.clear();
+    }
+
+private:
+    Context&                   m_ctx;
+    size_t                     m_windows;
+    std::vector<book_request>  m_books;
+    std::vector<query_request> m_queries;
+    std::vector<size_t>        m_answers;
+};
+
+/**
+ * Session: reads request lines until the peer shuts down its side and writes the answers back.
+ * Everything available is read and applied before waiting, answers are sent before more input is
+ * read. After max_turn_reads reads in a row the session goes to the `ready` ones.
+ */
+template<typename Context>
+session_task run_session(connection& conn, request_executor<Context>& executor,
+                         std::vector<connection*>& ready, const server_options& options)
+{
+    auto        input = std::make_unique<char[]>(options.input_capacity);
+    size_t      used  = 0;
+    std::string output;
+    size_t      sent  = 0;
+    bool        eof   = false;
+    size_t      reads = 0;
+
+    for (;;) {
+        while (sent < output.size()) {
+            auto ret =
+                ::send(conn.socket, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                co_return;
+            }
+            sent += size_t(ret);
+        }
+        if (sent == output.size()) {
+            output.clear();
+            sent = 0;
+        }
+        if (eof && output.empty())
+            co_return;
+
+        bool progress = false;
+        if (!eof && output.size() - sent < options.max_pending) {
+            if (used == options.input_capacity)
+                co_return;
+            auto ret = ::recv(conn.socket, input.get() + used, options.input_capacity - used, 0);
+            if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+                co_return;
+            progress = ret >= 0 || errno == EINTR;
+            eof      = ret == 0;
+            used += size_t(std::max<ssize_t>(ret, 0));
+
+            // Complete lines only, the rest waits for more input
+            size_t end = used;
+            while (!eof && end > 0 && input[end - 1] != '\n')
+                --end;
+            if (end) {
+                executor.execute({input.get(), end}, output);
+                std::memmove(input.get(), input.get() + end, used - end);
+                used -= end;
+            }
+        }
+        if (!progress) {
+            reads = 0;
+            co_await socket_event{conn};
+        } else if (++reads == options.max_turn_reads) {
+            reads = 0;
+            co_await reschedule{conn, ready};
+        }
+    }
+}
+
+} // ::anonymous
+
+template<typename Context>
+bool serve(Context& ctx, const char* path, const volatile std::sig_atomic_t& stop,
+           const std::function<void()>& poll, const server_options& options)
+{
+    sockaddr_un addr{};
+    if (std::strlen(path) >= sizeof(addr.sun_path))
+        return false;
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path);
+
+    // A socket left by a previous run is replaced, anything else there is kept
+    struct stat st;
+    if (::stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        ::unlink(path);
+
+    file_descriptor listener{::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)};
+    if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        return false;
+
+    file_descriptor poller{::epoll_create1(EPOLL_CLOEXEC)};
+    epoll_event     event{};
+    event.events   = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (::listen(listener, SOMAXCONN) < 0 || poller < 0 ||
+        ::epoll_ctl(poller, EPOLL_CTL_ADD, listener, &event) < 0) {
+        ::unlink(path);
+        return false;
+    }
+
+    request_executor<Context>                                    executor{ctx};
+    std::unordered_map<connection*, std::unique_ptr<connection>> sessions;
+    // sessions that gave up their turn, resumed after the socket events
+    std::vector<connection*>                                     ready;
+    std::vector<connection*>                                     runnable;
+
+    auto resume = [&](connection* conn) {
+        if (conn->waiter)
+            conn->waiter.resume();
+        if (conn->task.done()) {
+            std::erase(ready, conn);
+            sessions.erase(conn);
+        }
+    };
+
+    auto accept_all = [&] {
+        for (;;) {
+            int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+            auto conn = std::make_unique<connection>(fd);
+
+            epoll_event event{};
+            event.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = conn.get();
+            if (::epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) < 0)
+                continue;
+            conn->task = run_session(*conn, executor, ready, options);
+            if (!conn->task.done())
+                sessions.emplace(conn.get(), std::move(conn));
+        }
+    };
+
+    epoll_event events[MAX_EVENTS];
+    while (!stop) {
+        auto timeout = ready.empty() ? POLL_INTERVAL_MS : 0;
+        auto count   = ::epoll_wait(poller, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < count; ++i) {
+            auto conn = static_cast<connection*>(events[i].data.ptr);
+            if (conn)
+                resume(conn);
+            else
+                accept_all();
+        }
+
+        // A session resumed by its socket event meanwhile just retries its I/O
+        runnable.swap(ready);
+        for (auto conn : runnable) {
+            conn->in_ready = false;
+            resume(conn);
+        }
+        runnable.clear();
+        if (poll)
+            poll();
+    }
+
+    sessions.clear();
+    ::unlink(path);
+    return true;
+}
+
+template bool serve(cached_context&, const char*, const volatile std::sig_atomic_t&,
+                    const std::function<void()>&, const server_options&);
+template bool serve(lazy_context&, const char*, const volatile std::sig_atomic_t&,
+                    const std::function<void()>&, const server_options&);
+template bool serve(approx_context&, const char*, const volatile std::sig_atomic_t&,
+                    const std::function<void()>&, const server_options&);
+
+} // ::hotel_processing
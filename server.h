@@ -0,0 +1,58 @@
+#pragma once
+
+#include <csignal>
+#include <functional>
+
+#include "hotels.h"
+
+namespace hotel_processing {
+
+// Limits of the server sessions
+struct server_options
+{
+    // Input buffer of a session, longer request lines end the session
+    size_t input_capacity{64 * 1024};
+    // Sessions with more unsent answers stop reading until the peer catches up
+    size_t max_pending{1024 * 1024};
+    // Reads in a row before a busy session lets the others run
+    size_t max_turn_reads{16};
+};
+
+/**
+ * Local socket server
+ *
+ * Listens on a Unix domain socket, every connection is a session sending request lines of the
+ * main.cpp format without the requests count:
+ *
+ *     BOOK time hotel_name client_id room_count
+ *     CLIENTS hotel_name
+ *     ROOMS hotel_name
+ *
+ * BOOKs get no reply, every CLIENTS/ROOMS is answered with a line of values for all context
+ * windows. Sessions are coroutines multiplexed on one epoll loop and share the context, so no
+ * locking is needed: the requests of a session are applied in its order, and everything read by
+ * one wake up of a session is applied in batches before the others run.
+ *
+ * @param ctx      context shared by all sessions
+ * @param path     socket path, a stale socket there is replaced; it's removed on return
+ * @param stop     the server returns once it's set, e.g. by SIGTERM
+ * @param poll     called between event loop iterations, at least every POLL_INTERVAL_MS
+ * @param options  session limits
+ * @return false if the socket can't be set up
+ */
+template<typename Context>
+bool serve(Context& ctx, const char* path, const volatile std::sig_atomic_t& stop,
+           const std::function<void()>& poll = {}, const server_options& options = {});
+
+// Longest wait for socket events, so `stop` is noticed even without traffic
+static inline constexpr int POLL_INTERVAL_MS = 200;
+
+// Instantiated in server.cpp
+extern template bool serve(cached_context&, const char*, const volatile std::sig_atomic_t&,
+                           const std::function<void()>&, const server_options&);
+extern template bool serve(lazy_context&, const char*, const volatile std::sig_atomic_t&,
+                           const std::function<void()>&, const server_options&);
+extern template bool serve(approx_context&, const char*, const volatile std::sig_atomic_t&,
+                           const std::function<void()>&, const server_options&);
+
+} // ::hotel_processing
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+#include "memory.h"
+#include "snapshot.h"
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The sliding_hll class
+ *
+ * Sliding window HyperLogLog: distinct clients estimation for any window ending at the current
+ * time. Every register keeps, for every rank, the latest time an item of that rank hit it. Register
+ * value for a window is the largest rank seen inside it. Memory is fixed:
+ * 2^precision * LEVELS * 4 bytes, standard error is about 1.04 / sqrt(2^precision).
+ *
+ * Times are stored as 32-bit offsets from a moving base, so windows must be shorter than 2^31
+ * seconds.
+ */
+template<typename Time>
+class sliding_hll
+{
+public:
+    static constexpr int MIN_PRECISION = 4;
+    static constexpr int MAX_PRECISION = 12;
+    // Ranks above it are counted as it: estimations are saturated at 2^precision * 2^LEVELS
+    static constexpr int LEVELS = 20;
+
+    explicit sliding_hll(int precision,
+                         std::pmr::memory_resource* memory = std::pmr::get_default_resource()) :
+        m_precision(std::clamp(precision, MIN_PRECISION, MAX_PRECISION)),
+        m_memory(memory),
+        m_latest(memory, registers() * LEVELS)
+    {
+        std::fill_n(m_latest.get(), m_latest.size(), 0);
+    }
+
+    // Precision giving the requested relative standard error
+    static int precision_for(double error)
+    {
+        auto registers = (1.04 / error) * (1.04 / error);
+        return std::clamp(int(std::ceil(std::log2(registers))), MIN_PRECISION, MAX_PRECISION);
+    }
+
+    size_t registers() const { return size_t(1) << m_precision; }
+    size_t memory() const { return registers() * LEVELS * sizeof(uint32_t); }
+
+    void add(uint32_t client, Time time)
+    {
+        if (m_empty) {
+            m_base  = time;
+            m_empty = false;
+        } else if (time < m_base) {
+            rebase(time);
+        } else if (uint64_t(time - m_base) >= MAX_OFFSET) {
+            rebase(time - MAX_WINDOW);
+        }
+
+        auto hash = mix(client);
+        auto reg  = size_t(hash >> (64 - m_precision));
+        auto rest = hash << m_precision;
+        auto rank = std::min(std::countl_zero(rest) + 1, LEVELS);
+
+        auto& latest = m_latest[reg * LEVELS + size_t(rank - 1)];
+        latest       = std::max(latest, uint32_t(time - m_base + 1));
+    }
+
+    // Estimated distinct clients added with time > since
+    size_t estimate(Time since) const
+    {
+        if (m_empty)
+            return 0;
+
+        // Offsets greater than it are inside the window
+        uint64_t threshold = 0;
+        if (since >= m_base)
+            threshold = uint64_t(since - m_base) + 1;
+        if (threshold >= MAX_OFFSET)
+            return 0;
+
+        double sum   = 0;
+        size_t zeros = 0;
+        for (size_t reg = 0; reg < registers(); ++reg) {
+            auto latest = &m_latest[reg * LEVELS];
+            int  rank   = LEVELS;
+            while (rank > 0 && latest[rank - 1] <= threshold)
+                --rank;
+            sum += std::ldexp(1.0, -rank);
+            zeros += rank == 0;
+        }
+
+        auto m        = double(registers());
+        auto estimate = alpha() * m * m / sum;
+        if (estimate <= 2.5 * m && zeros)
+            estimate = m * std::log(m / double(zeros));
+        return size_t(std::llround(estimate));
+    }
+
+    void clear()
+    {
+        std::fill_n(m_latest.get(), registers() * LEVELS, 0);
+        m_empty = true;
+    }
+
+    void save(snapshot_writer& out) const
+    {
+        out.value(int64_t(m_precision));
+        out.value(int64_t(m_empty));
+        out.value(int64_t(m_base));
+        out.array(m_latest.get(), registers() * LEVELS);
+    }
+
+    // Replaces the state, precision included
+    bool load(snapshot_reader& in)
+    {
+        int64_t precision, empty, base;
+        if (!in.value(precision) || !in.value(empty) || !in.value(base) ||
+            precision < MIN_PRECISION || precision > MAX_PRECISION)
+            return false;
+
+        if (precision != m_precision) {
+            m_precision = int(precision);
+            m_latest    = pmr_array<uint32_t>(m_memory, registers() * LEVELS);
+        }
+        m_empty = empty != 0;
+        m_base  = Time(base);
+        return in.array(m_latest.get(), registers() * LEVELS);
+    }
+
+private:
+    static constexpr uint64_t MAX_OFFSET = std::numeric_limits<uint32_t>::max();
+    static constexpr Time     MAX_WINDOW = Time(1) << 31;
+
+    static uint64_t mix(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    double alpha() const
+    {
+        switch (registers()) {
+            case 16: return 0.673;
+            case 32: return 0.697;
+            case 64: return 0.709;
+            default: return 0.7213 / (1.0 + 1.079 / double(registers()));
+        }
+    }
+
+    // Move base, entries older than new base are dropped, too new ones are saturated
+    void rebase(Time base)
+    {
+        for (size_t i = 0; i < registers() * LEVELS; ++i) {
+            if (!m_latest[i])
+                continue;
+            auto time = m_base + Time(m_latest[i] - 1);
+            if (time < base)
+                m_latest[i] = 0;
+            else
+                m_latest[i] = uint32_t(std::min<uint64_t>(uint64_t(time - base) + 1, MAX_OFFSET));
+        }
+        m_base = base;
+    }
+
+private:
+    int                        m_precision;
+    std::pmr::memory_resource* m_memory;
+    pmr_array<uint32_t>        m_latest;
+    Time                       m_base{};
+    bool                       m_empty{true};
+};
+
+} // ::priv
+} // ::hotel_processing
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+
+namespace hotel_processing {
+namespace priv {
+
+/**
+ * The snapshot_writer class
+ *
+ * Sequential binary writer of context snapshots. Values and arrays are written as raw bytes in
+ * native byte order, every array is zero padded to ALIGN, so arrays in an mmapped snapshot are
+ * aligned and restored with a single memcpy.
+ */
+class snapshot_writer
+{
+public:
+    static constexpr size_t ALIGN = 8;
+
+    explicit snapshot_writer(std::ostream& out) : m_out(out) {}
+
+    template<typename T>
+    void value(const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(&value, sizeof(value));
+    }
+
+    template<typename T>
+    void array(const T* data, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(data, count * sizeof(T));
+        pad();
+    }
+
+    // Parts of a single array: array_part()... then pad()
+    template<typename T>
+    void array_part(const T* data, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        write(data, count * sizeof(T));
+    }
+
+    void pad()
+    {
+        static constexpr char zeroes[ALIGN] = {};
+        write(zeroes, (ALIGN - m_offset % ALIGN) % ALIGN);
+    }
+
+    bool ok() const { return bool(m_out); }
+
+private:
+    void write(const void* data, size_t size)
+    {
+        m_out.write(static_cast<const char*>(data), std::streamsize(size));
+        m_offset += size;
+    }
+
+private:
+    std::ostream& m_out;
+    size_t        m_offset{};
+};
+
+/**
+ * The snapshot_reader class
+ *
+ * Reads what snapshot_writer wrote from memory with bounds checks. Any failed read fails all
+ * the following ones.
+ */
+class snapshot_reader
+{
+public:
+    explicit snapshot_reader(std::string_view data) : m_data(data) {}
+
+    template<typename T>
+    bool value(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return read(&value, sizeof(value));
+    }
+
+    template<typename T>
+    bool array(T* data, size_t count)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return count <= m_data.size() / sizeof(T) && read(data, count * sizeof(T)) && skip_pad();
+    }
+
+    bool ok() const { return m_ok; }
+
+    // Bytes left to read, counts read from the snapshot are checked against it before allocating
+    size_t remaining() const { return m_ok ? m_data.size() - m_offset : 0; }
+
+    // `count` items of `item_size` bytes can still be read
+    bool fits(uint64_t count, size_t item_size) const { return count <= remaining() / item_size; }
+
+    // Everything is read
+    bool done() const { return m_ok && m_offset == m_data.size(); }
+
+private:
+    bool read(void* data, size_t size)
+    {
+        if (!m_ok || size > m_data.size() - m_offset)
+            return m_ok = false;
+        if (size)
+            std::memcpy(data, m_data.data() + m_offset, size);
+        m_offset += size;
+        return true;
+    }
+
+    bool skip_pad()
+    {
+        auto pad = (snapshot_writer::ALIGN - m_offset % snapshot_writer::ALIGN) %
+                   snapshot_writer::ALIGN;
+        if (pad > m_data.size() - m_offset)
+            return m_ok = false;
+        m_offset += pad;
+        return true;
+    }
+
+private:
+    std::string_view m_data;
+    size_t           m_offset{};
+    bool             m_ok{true};
+};
+
+} // ::priv
+} // ::hotel_processing
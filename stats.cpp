@@ -0,0 +1,39 @@
+#include <cmath>
+#include <thread>
+
+#include "stats.h"
+
+namespace hotel_processing {
+
+double ns_per_tick()
+{
+    static const double scale = [] {
+        namespace dt = std::chrono;
+        auto start_time  = dt::steady_clock::now();
+        auto start_ticks = priv::ticks();
+        std::this_thread::sleep_for(dt::milliseconds{10});
+        auto ns    = dt::duration_cast<dt::nanoseconds>(dt::steady_clock::now() - start_time);
+        auto ticks = priv::ticks() - start_ticks;
+        return ticks ? double(ns.count()) / double(ticks) : 1.0;
+    }();
+    return scale;
+}
+
+void write_histogram(std::ostream& out, const char* title, const log2_histogram& histogram,
+                     double scale, const char* unit)
+{
+    auto value = [scale](double value) {
+        return std::llround(value * scale);
+    };
+
+    out << title << ": count " << histogram.count();
+    if (histogram.count()) {
+        out << ", " << unit << ": mean " << value(histogram.mean())
+            << ", p50 " << value(double(histogram.quantile(0.5)))
+            << ", p99 " << value(double(histogram.quantile(0.99)))
+            << ", max " << value(double(histogram.max()));
+    }
+    out << '\n';
+}
+
+} // ::hotel_processing
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace hotel_processing {
+
+// Instrumentation is compiled in with ENABLE_STATS, otherwise recording compiles out
+#ifdef HOTEL_STATS
+static inline constexpr bool STATS_ENABLED = true;
+#else
+static inline constexpr bool STATS_ENABLED = false;
+#endif
+
+/**
+ * The log2_histogram class
+ *
+ * Counts of values by bit width: bucket N holds values in [2^(N-1), 2^N). Recording is a few
+ * instructions, quantiles are bucket upper bounds.
+ */
+class log2_histogram
+{
+public:
+    static constexpr size_t BUCKETS = 65;
+
+    void record(uint64_t value, uint64_t count = 1)
+    {
+        m_buckets[std::bit_width(value)] += count;
+        m_count += count;
+        m_sum += value * count;
+        m_max = std::max(m_max, value);
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t max() const { return m_max; }
+    double   mean() const { return m_count ? double(m_sum) / double(m_count) : 0.0; }
+
+    // Upper bound of the values below the quantile, q in [0, 1]
+    uint64_t quantile(double q) const
+    {
+        auto     rank = uint64_t(q * double(m_count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += m_buckets[i];
+            if (seen > rank)
+                return std::min(m_max, i ? (uint64_t(2) << (i - 1)) - 1 : 0);
+        }
+        return m_max;
+    }
+
+    void clear() { *this = {}; }
+
+private:
+    std::array<uint64_t, BUCKETS> m_buckets{};
+    uint64_t                      m_count{};
+    uint64_t                      m_sum{};
+    uint64_t                      m_max{};
+};
+
+struct hotel_stats
+{
+    uint64_t bookings{};
+    uint64_t cleanups{};
+    uint64_t evicted{};
+    // high-water marks: bookings kept in the log, clients tracked by the engine
+    uint64_t peak_bookings{};
+    uint64_t peak_clients{};
+};
+
+/**
+ * Context statistics, latencies are in TSC ticks (nanoseconds where there's no TSC)
+ */
+struct context_stats
+{
+    log2_histogram book;
+    log2_histogram clients;
+    log2_histogram rooms;
+    log2_histogram cleanup;
+    // bookings evicted by a cleanup
+    log2_histogram evicted;
+
+    uint64_t stored_bookings{};
+    uint64_t peak_stored_bookings{};
+
+    std::vector<hotel_stats> hotels; // per hotel ID
+};
+
+namespace priv {
+
+inline uint64_t ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count());
+#endif
+}
+
+/**
+ * The op_timer class
+ *
+ * Records scope duration into the histogram, empty when instrumentation is compiled out
+ */
+template<bool Enabled = STATS_ENABLED>
+class op_timer
+{
+public:
+    explicit op_timer(log2_histogram& histogram) : m_histogram(histogram), m_start(ticks()) {}
+    ~op_timer() { m_histogram.record(ticks() - m_start); }
+
+private:
+    log2_histogram& m_histogram;
+    uint64_t        m_start;
+};
+
+template<>
+class op_timer<false>
+{
+public:
+    explicit op_timer(log2_histogram&) {}
+};
+
+} // ::priv
+
+// Nanoseconds per tick, calibrated once
+double ns_per_tick();
+
+// Single report line: count, mean, p50, p99 and max multiplied by scale
+void write_histogram(std::ostream& out, const char* title, const log2_histogram& histogram,
+                     double scale, const char* unit);
+
+/**
+ * Human readable report: operation latencies, eviction and high-water marks, and the hotels with
+ * the most bookings
+ *
+ * @param name  callable with (hotel ID) returning the hotel name
+ * @param top   hotels to list
+ */
+template<typename Name>
+void write_stats(std::ostream& out, const context_stats& stats, Name&& name, size_t top = 10)
+{
+    if (!STATS_ENABLED) {
+        out << "statistics are not compiled in, build with -DENABLE_STATS=ON\n";
+        return;
+    }
+
+    auto scale = ns_per_tick();
+    write_histogram(out, "book", stats.book, scale, "ns");
+    write_histogram(out, "clients", stats.clients, scale, "ns");
+    write_histogram(out, "rooms", stats.rooms, scale, "ns");
+    write_histogram(out, "cleanup", stats.cleanup, scale, "ns");
+    write_histogram(out, "evicted", stats.evicted, 1.0, "bookings");
+    out << "stored bookings: " << stats.stored_bookings << ", peak " << stats.peak_stored_bookings
+        << '\n';
+
+    std::vector<uint32_t> order(stats.hotels.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    top = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + ptrdiff_t(top), order.end(),
+                      [&](uint32_t a, uint32_t b) {
+                          return stats.hotels[a].bookings > stats.hotels[b].bookings;
+                      });
+
+    out << "top hotels by bookings (bookings cleanups evicted peak_bookings peak_clients):\n";
+    for (size_t i = 0; i < top; ++i) {
+        auto const& hotel = stats.hotels[order[i]];
+        out << "  " << name(order[i]) << ' ' << hotel.bookings << ' ' << hotel.cleanups << ' '
+            << hotel.evicted << ' ' << hotel.peak_bookings << ' ' << hotel.peak_clients << '\n';
+    }
+}
+
+} // ::hotel_processing
@@ -1,6 +1,23 @@
 #include "tests.h"
+#include "binlog.h"
+#include "concurrent_context.h"
 #include "hotels.h"
+#include "output.h"
+#include "parser.h"
+#include "pipeline.h"
+#include "server.h"
 #include <random>
+#include <thread>
+#include <cmath>
+#include <unordered_map>
+#include <deque>
+#include <map>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -240,6 +257,1202 @@ void Test6() {
     ASSERT_EQUAL(manager.clients("mariot"), 1);
 }
 
+void TestHotelIds() {
+    hotel_processing::context booker;
+    ASSERT_EQUAL(booker.clients("a"), 0);
+    ASSERT_EQUAL(booker.rooms("b"), 0);
+    ASSERT_EQUAL(booker.hotels_count(), 0);
+    ASSERT(!booker.find("a"));
+
+    auto a = booker.intern("a");
+    auto b = booker.intern("b");
+    ASSERT(a != b);
+    ASSERT_EQUAL(booker.intern("a"), a);
+    ASSERT_EQUAL(*booker.find("b"), b);
+
+    booker.book(1, a, 7, 2);
+    booker.book(2, "a", 8, 3);
+    ASSERT_EQUAL(booker.rooms(a), 5);
+    ASSERT_EQUAL(booker.clients("a"), 2);
+    ASSERT_EQUAL(booker.rooms(b), 0);
+    ASSERT_EQUAL(booker.hotels_count(), 2);
+}
+
+void TestBatches() {
+    hotel_processing::context single;
+    hotel_processing::context batched;
+
+    auto a = batched.intern("a");
+    auto b = batched.intern("b");
+    single.intern("a");
+    single.intern("b");
+
+    vector<hotel_processing::book_request> books = {
+        {0, a, 1, 10}, {0, b, 1, 1}, {1, a, 2, 1}, {1, a, 1, 1}, {86400, b, 3, 2},
+    };
+    for (auto const& req : books)
+        single.book(req.time, req.hotel, req.client, req.rooms);
+    batched.book_batch(books);
+    ASSERT_EQUAL(batched.current_time(), 86400);
+
+    using hotel_processing::query_kind;
+    vector<hotel_processing::query_request> queries = {
+        {query_kind::rooms, a}, {query_kind::clients, b}, {query_kind::clients, a},
+        {query_kind::rooms, hotel_processing::INVALID_HOTEL}, {query_kind::rooms, b},
+        {query_kind::rooms, a},
+    };
+    vector<size_t> answers(queries.size());
+    batched.query_batch(queries, answers);
+
+    vector<size_t> expected;
+    for (auto const& req : queries) {
+        if (req.hotel == hotel_processing::INVALID_HOTEL)
+            expected.push_back(0);
+        else if (req.kind == query_kind::clients)
+            expected.push_back(single.clients(req.hotel));
+        else
+            expected.push_back(single.rooms(req.hotel));
+    }
+    ASSERT_EQUAL(answers, expected);
+    ASSERT_EQUAL(answers, (vector<size_t>{2, 1, 2, 0, 2, 2}));
+}
+
+void TestReclaim() {
+    hotel_processing::context booker;
+    for (int i = 0; i < 10000; ++i)
+        booker.book(i, "idle", i, 1);
+    ASSERT_EQUAL(booker.stored_bookings(), 10000);
+
+    // "idle" is never queried, its bookings must go away as time passes
+    for (int64_t tm = 10000; tm < 10 * 86400; tm += 60)
+        booker.book(tm, "busy", 1, 1);
+
+    ASSERT(booker.stored_bookings() <= 1440 + 20);
+    ASSERT(booker.reclaim_pending() <= 100);
+    ASSERT_EQUAL(booker.rooms("busy"), 1440);
+    ASSERT_EQUAL(booker.rooms("idle"), 0);
+
+    // Jump far ahead: everything is reclaimable at once
+    booker.book(1'000'000'000'000, "other", 1, 1);
+    booker.reclaim();
+    ASSERT_EQUAL(booker.stored_bookings(), 1);
+    ASSERT_EQUAL(booker.reclaim_pending(), 1);
+}
+
+void TestWindows() {
+    const vector<int64_t> windows = {86400, 3600, 7 * 86400};
+    hotel_processing::context shared{windows};
+    std::deque<hotel_processing::context> separate;
+    for (auto window : windows)
+        separate.emplace_back(vector<int64_t>{window});
+
+    std::mt19937 gen(11);
+    int64_t tm = 0;
+    for (int i = 0; i < 20000; ++i) {
+        tm += gen() % 600;
+        auto hotel = "h" + to_string(gen() % 5);
+        if (gen() % 4) {
+            auto client = gen() % 50;
+            auto rooms = gen() % 5;
+            shared.book(tm, hotel, client, rooms);
+            for (auto& ctx : separate)
+                ctx.book(tm, hotel, client, rooms);
+        } else {
+            for (size_t w = 0; w < windows.size(); ++w) {
+                ASSERT_EQUAL(shared.rooms(hotel, windows[w]), separate[w].rooms(hotel));
+                ASSERT_EQUAL(shared.clients(hotel, windows[w]), separate[w].clients(hotel));
+            }
+            ASSERT_EQUAL(shared.rooms(hotel), separate[0].rooms(hotel));
+        }
+    }
+
+    ASSERT_EQUAL(shared.window_index(3600), 1);
+    ASSERT_EQUAL(shared.window_index(60), 3);
+    ASSERT_EQUAL(shared.rooms("h1", 60), 0);
+
+    shared.reclaim();
+    for (auto& ctx : separate)
+        ctx.reclaim();
+    ASSERT_EQUAL(shared.stored_bookings(), separate[2].stored_bookings());
+}
+
+void TestApproximateClients() {
+    hotel_processing::engine_options options{0.05};
+    hotel_processing::context exact{{3600, 86400}};
+    hotel_processing::approx_context approx{{3600, 86400}, options};
+
+    std::mt19937 gen(5);
+    int64_t tm = -1'000'000'000'000'000'000;
+    for (int i = 0; i < 300'000; ++i) {
+        tm += gen() % 2;
+        auto client = gen() % 200'000;
+        exact.book(tm, "a", client, 1);
+        approx.book(tm, "a", client, 1);
+
+        if (i % 50'000 == 49'999) {
+            for (int64_t window : {3600, 86400}) {
+                auto expected = double(exact.clients("a", window));
+                auto estimated = double(approx.clients("a", window));
+                ASSERT(std::abs(estimated - expected) <= 4 * options.clients_error * expected);
+                ASSERT_EQUAL(approx.rooms("a", window), exact.rooms("a", window));
+            }
+        }
+    }
+
+    // Everything is out of the window
+    approx.book(tm + 86400, "b", 1, 1);
+    ASSERT_EQUAL(approx.clients("a"), 0);
+    ASSERT_EQUAL(approx.clients("b"), 1);
+
+    hotel_processing::priv::sliding_hll<int64_t> hll{
+        hotel_processing::priv::sliding_hll<int64_t>::precision_for(0.1)};
+    ASSERT(hll.memory() <= 16 * 1024);
+}
+
+void TestEngines() {
+    const vector<int64_t> windows = {3600, 86400};
+    hotel_processing::cached_context cached{windows};
+    hotel_processing::lazy_context lazy{windows};
+    auto any = hotel_processing::make_context(hotel_processing::engine_kind::approx, windows);
+    ASSERT(std::holds_alternative<hotel_processing::approx_context>(any));
+
+    std::mt19937 gen(17);
+    int64_t tm = 0;
+    for (int i = 0; i < 20000; ++i) {
+        tm += gen() % 300;
+        auto hotel = "h" + to_string(gen() % 7);
+        if (gen() % 4) {
+            auto client = gen() % 30;
+            auto rooms = gen() % 5;
+            cached.book(tm, hotel, client, rooms);
+            lazy.book(tm, hotel, client, rooms);
+            std::visit([&](auto& ctx) { ctx.book(tm, hotel, client, rooms); }, any);
+        } else {
+            for (auto window : windows) {
+                auto rooms = cached.rooms(hotel, window);
+                ASSERT_EQUAL(rooms, lazy.rooms(hotel, window));
+                ASSERT_EQUAL(cached.clients(hotel, window), lazy.clients(hotel, window));
+                std::visit([&](auto& ctx) { ASSERT_EQUAL(ctx.rooms(hotel, window), rooms); }, any);
+            }
+        }
+    }
+
+    ASSERT_EQUAL(cached.stored_bookings(), lazy.stored_bookings());
+    ASSERT(hotel_processing::parse_engine("lazy") == hotel_processing::engine_kind::lazy);
+    ASSERT(!hotel_processing::parse_engine("fast"));
+}
+
+template<typename Context>
+void CheckSnapshot(const string& path) {
+    const vector<int64_t> windows = {3600, 86400};
+    Context original{windows};
+
+    std::mt19937 gen(23);
+    int64_t tm = 0;
+    auto book = [&](auto&... contexts) {
+        tm += gen() % 60;
+        auto hotel = "h" + to_string(gen() % 50);
+        auto client = gen() % 1000;
+        auto rooms = gen() % 5;
+        (contexts.book(tm, hotel, client, rooms), ...);
+    };
+
+    for (int i = 0; i < 5000; ++i)
+        book(original);
+    ASSERT(original.save(path.c_str()));
+
+    Context restored;
+    restored.book(1, "x", 1, 1);
+    ASSERT(restored.load(path.c_str()));
+    ASSERT(restored.windows().size() == windows.size());
+    ASSERT_EQUAL(restored.current_time(), original.current_time());
+    ASSERT_EQUAL(restored.hotels_count(), original.hotels_count());
+    ASSERT_EQUAL(restored.stored_bookings(), original.stored_bookings());
+    ASSERT_EQUAL(restored.reclaim_pending(), original.reclaim_pending());
+    ASSERT(!restored.find("x"));
+
+    for (int i = 0; i < 5000; ++i) {
+        book(original, restored);
+        if (i % 10 == 0) {
+            auto hotel = "h" + to_string(gen() % 50);
+            for (auto window : windows) {
+                ASSERT_EQUAL(restored.clients(hotel, window), original.clients(hotel, window));
+                ASSERT_EQUAL(restored.rooms(hotel, window), original.rooms(hotel, window));
+            }
+        }
+    }
+}
+
+void TestHistory() {
+    const int64_t retention = 20000;
+    hotel_processing::engine_options options;
+    options.history = retention;
+    hotel_processing::context ctx{{3600}, options};
+
+    struct entry {
+        int64_t time;
+        uint32_t client;
+        size_t rooms;
+    };
+    vector<vector<entry>> bookings(5);
+    std::mt19937 gen(31);
+
+    auto check = [&](const auto& ctx, size_t hotel, int64_t from, int64_t to) {
+        auto now = ctx.current_time();
+        std::set<uint32_t> clients;
+        size_t rooms = 0;
+        for (auto const& b : bookings[hotel]) {
+            if (b.time > std::max(from, now - retention) && b.time <= to) {
+                clients.insert(b.client);
+                rooms += b.rooms;
+            }
+        }
+        auto name = "h" + to_string(hotel);
+        ASSERT_EQUAL(ctx.clients(name, from, to), clients.size());
+        ASSERT_EQUAL(ctx.rooms(name, from, to), rooms);
+    };
+
+    int64_t tm = 0;
+    for (int i = 0; i < 20000; ++i) {
+        tm += gen() % 60;
+        auto hotel = gen() % bookings.size();
+        entry b{tm, uint32_t(gen() % 300), gen() % 5};
+        bookings[hotel].push_back(b);
+        ctx.book(b.time, "h" + to_string(hotel), b.client, b.rooms);
+
+        if (i % 50 == 0) {
+            auto from = tm - int64_t(gen() % 30000);
+            check(ctx, gen() % bookings.size(), from, from + int64_t(gen() % 25000));
+            auto hotel = "h" + to_string(gen() % bookings.size());
+            ASSERT_EQUAL(ctx.rooms(hotel, tm - 3600, tm), ctx.rooms(hotel));
+            ASSERT_EQUAL(ctx.clients(hotel, tm - 3600, tm), ctx.clients(hotel));
+        }
+    }
+    ASSERT_EQUAL(ctx.rooms("missing", 0, tm), 0);
+    ASSERT_EQUAL(ctx.clients("h0", tm, tm - 1), 0);
+
+    // History survives the snapshot
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_history_test").string();
+    ASSERT(ctx.save(path.c_str()));
+    hotel_processing::context restored;
+    ASSERT(restored.load(path.c_str()));
+    std::filesystem::remove(path);
+    for (size_t hotel = 0; hotel < bookings.size(); ++hotel) {
+        check(restored, hotel, tm - retention, tm);
+        check(restored, hotel, tm - 5000, tm - 1000);
+    }
+
+    // Disabled by default
+    hotel_processing::context plain;
+    plain.book(1, "a", 1, 1);
+    ASSERT_EQUAL(plain.rooms("a", 0, 1), 0);
+}
+
+void TestSnapshot() {
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_snapshot_test").string();
+    CheckSnapshot<hotel_processing::cached_context>(path);
+    CheckSnapshot<hotel_processing::lazy_context>(path);
+    CheckSnapshot<hotel_processing::approx_context>(path);
+
+    // Log columns are saved packed as they are, full width ones too
+    hotel_processing::cached_context wide{{10'000'000'000}};
+    wide.book(1, "a", 1, 100'000);
+    wide.book(5'000'000'000, "a", 2, 1);
+    ASSERT(wide.save(path.c_str()));
+    hotel_processing::cached_context wide_restored;
+    ASSERT(wide_restored.load(path.c_str()));
+    wide.book(5'000'000'001, "a", 3, 2);
+    wide_restored.book(5'000'000'001, "a", 3, 2);
+    ASSERT_EQUAL(wide_restored.rooms("a"), wide.rooms("a"));
+    ASSERT_EQUAL(wide_restored.clients("a"), 3);
+    wide.book(12'000'000'000, "a", 4, 1);
+    wide_restored.book(12'000'000'000, "a", 4, 1);
+    ASSERT_EQUAL(wide_restored.rooms("a"), wide.rooms("a"));
+    ASSERT_EQUAL(wide_restored.clients("a"), wide.clients("a"));
+
+    // Another engine's and damaged snapshots are rejected, context stays the same
+    hotel_processing::lazy_context lazy;
+    lazy.book(1, "a", 1, 1);
+    ASSERT(!lazy.load(path.c_str()));
+    ASSERT(!lazy.load((path + ".missing").c_str()));
+    ASSERT_EQUAL(lazy.clients("a"), 1);
+
+    hotel_processing::approx_context approx;
+    hotel_processing::input_buffer buffer;
+    ASSERT(buffer.open(path.c_str()));
+    auto data = string{buffer.data()};
+    {
+        std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+        ofs << data.substr(0, data.size() / 2);
+    }
+    ASSERT(!approx.load(path.c_str()));
+
+    // Counts are checked against the snapshot size before anything is allocated for them
+    hotel_processing::engine_options options;
+    options.history = 100;
+    hotel_processing::cached_context saved{{100}, options};
+    for (uint32_t i = 0; i < 10; ++i)
+        saved.book(i, "needle", i, 1);
+    ASSERT(saved.save(path.c_str()));
+    ASSERT(buffer.open(path.c_str()));
+    data = string{buffer.data()};
+
+    auto patch = [&](size_t offset, uint64_t value) {
+        auto patched = data;
+        std::memcpy(patched.data() + offset, &value, sizeof(value));
+        std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+        ofs << patched;
+    };
+    // Booking log size follows the hotel name padded to 8 bytes
+    auto log_size = (data.find("needle") + 6 + 7) / 8 * 8;
+    uint64_t size;
+    std::memcpy(&size, data.data() + log_size, sizeof(size));
+    ASSERT_EQUAL(size, 10);
+
+    hotel_processing::cached_context restored;
+    restored.book(1, "a", 1, 1);
+    patch(log_size, uint64_t(1) << 47);
+    ASSERT(!restored.load(path.c_str()));
+    ASSERT_EQUAL(restored.rooms("a"), 1);
+
+    // Any field set to a huge value fails the load or loads, never throws
+    for (size_t offset = 0; offset + sizeof(uint64_t) <= data.size(); offset += sizeof(uint64_t)) {
+        patch(offset, uint64_t(1) << 47);
+        restored.load(path.c_str());
+    }
+    std::filesystem::remove(path);
+}
+
+void TestConcurrent() {
+    const vector<int64_t> windows = {3600, 86400};
+    hotel_processing::concurrent_context shared{windows};
+    std::deque<hotel_processing::context> expected;
+
+    // Writers book disjoint hotels with interleaved times, readers poll concurrently
+    constexpr int WRITERS = 4;
+    constexpr int BOOKINGS = 20000;
+    for (int w = 0; w < WRITERS; ++w)
+        expected.emplace_back(windows);
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> reads{0};
+    std::vector<std::thread> threads;
+    for (int w = 0; w < WRITERS; ++w) {
+        threads.emplace_back([&, w] {
+            std::mt19937 gen(w);
+            for (int i = 0; i < BOOKINGS; ++i) {
+                auto tm = int64_t(i) * 20 + w;
+                auto hotel = "w" + to_string(w) + "h" + to_string(gen() % 10);
+                auto client = gen() % 100;
+                auto rooms = gen() % 5;
+                shared.book(tm, hotel, client, rooms);
+                expected[w].book(tm, hotel, client, rooms);
+            }
+        });
+    }
+    std::thread reader([&] {
+        while (!done.load()) {
+            for (hotel_processing::hotel_id_t id = 0; id < shared.hotels_count(); ++id) {
+                // Clients are taken from 100 IDs
+                if (shared.clients(id) > 100)
+                    reads = size_t(-1);
+            }
+            ++reads;
+        }
+    });
+    for (auto& thread : threads)
+        thread.join();
+    done = true;
+    reader.join();
+    ASSERT(reads != size_t(-1));
+
+    // After maintenance every hotel is cleaned up at the largest booked time
+    ASSERT_EQUAL(shared.current_time(), int64_t(BOOKINGS - 1) * 20 + WRITERS - 1);
+    shared.maintain();
+    ASSERT_EQUAL(shared.hotels_count(), size_t(WRITERS * 10));
+    for (int w = 0; w < WRITERS; ++w) {
+        expected[w].set_time(shared.current_time());
+        for (int h = 0; h < 10; ++h) {
+            auto hotel = "w" + to_string(w) + "h" + to_string(h);
+            auto id = *shared.find(hotel);
+            for (auto window : windows) {
+                ASSERT_EQUAL(shared.clients(id, window), expected[w].clients(hotel, window));
+                ASSERT_EQUAL(shared.rooms(id, window), expected[w].rooms(hotel, window));
+            }
+        }
+    }
+    ASSERT_EQUAL(shared.rooms("unknown"), 0);
+    ASSERT_EQUAL(shared.clients(hotel_processing::INVALID_HOTEL), 0);
+}
+
+void TestConcurrentSameHotel() {
+    // Both writers book one hotel, times interleave whatever order they get its lock in
+    const vector<int64_t> windows = {30000, 40000};
+    hotel_processing::concurrent_context shared{windows};
+    hotel_processing::context expected{windows};
+
+    constexpr int WRITERS = 2;
+    constexpr int BOOKINGS = 10000;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < WRITERS; ++w) {
+        threads.emplace_back([&, w] {
+            for (int i = 0; i < BOOKINGS; ++i)
+                shared.book(int64_t(i) * WRITERS + w, "hilton", i % 100, 1 + i % 3);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    for (int i = 0; i < BOOKINGS; ++i)
+        for (int w = 0; w < WRITERS; ++w)
+            expected.book(int64_t(i) * WRITERS + w, "hilton", i % 100, 1 + i % 3);
+
+    // The clean up evicts the first half of the bookings
+    const int64_t last = 50000;
+    shared.book(last, "hilton", 100, 1);
+    expected.book(last, "hilton", 100, 1);
+    shared.maintain();
+    auto id = *shared.find("hilton");
+    for (auto window : windows) {
+        ASSERT_EQUAL(shared.clients(id, window), expected.clients("hilton", window));
+        ASSERT_EQUAL(shared.rooms(id, window), expected.rooms("hilton", window));
+    }
+}
+
+void TestStats() {
+    hotel_processing::context ctx;
+    ctx.book(0, "a", 1, 1);
+    ctx.book(0, "a", 2, 1);
+    ctx.book(100000, "b", 1, 1);
+    ASSERT_EQUAL(ctx.clients("a"), 0);
+    ASSERT_EQUAL(ctx.hotel_name(1), "b");
+
+    auto const& stats = ctx.stats();
+    if (!hotel_processing::STATS_ENABLED) {
+        ASSERT(stats.hotels.empty());
+        ASSERT_EQUAL(stats.book.count(), 0u);
+        return;
+    }
+
+    ASSERT_EQUAL(stats.book.count(), 3u);
+    ASSERT_EQUAL(stats.clients.count(), 1u);
+    ASSERT_EQUAL(stats.hotels[0].bookings, 2u);
+    ASSERT_EQUAL(stats.hotels[0].evicted, 2u);
+    ASSERT_EQUAL(stats.hotels[0].peak_bookings, 2u);
+    ASSERT_EQUAL(stats.stored_bookings, 1u);
+    ASSERT_EQUAL(stats.peak_stored_bookings, 3u);
+
+    ctx.reset_stats();
+    ASSERT_EQUAL(ctx.stats().book.count(), 0u);
+    ASSERT_EQUAL(ctx.stats().hotels.size(), 2u);
+}
+
+template<typename Context>
+void CheckReorder(bool exact_clients) {
+    const vector<int64_t> windows = {3600, 600};
+    const int64_t tolerance = 300;
+    hotel_processing::engine_options options;
+    options.reorder = tolerance;
+    Context ctx{windows, options};
+
+    // Bookings arrive up to `tolerance` seconds late
+    struct entry {
+        int64_t arrival;
+        int64_t time;
+        size_t hotel;
+        uint32_t client;
+        size_t rooms;
+    };
+    std::mt19937 gen(41);
+    vector<entry> events;
+    int64_t tm = 0;
+    for (int i = 0; i < 20000; ++i) {
+        tm += gen() % 10;
+        events.push_back({tm + int64_t(gen() % (tolerance + 1)), tm, gen() % 10, uint32_t(gen() % 50),
+                          gen() % 5});
+    }
+    std::stable_sort(events.begin(), events.end(), [](auto const& a, auto const& b) {
+        return a.arrival < b.arrival;
+    });
+
+    vector<entry> seen;
+    int64_t now = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        auto const& e = events[i];
+        ctx.book(e.time, "h" + to_string(e.hotel), e.client, e.rooms);
+        seen.push_back(e);
+        now = std::max(now, e.time);
+        ASSERT_EQUAL(ctx.current_time(), now);
+
+        if (i % 97 == 0) {
+            auto hotel = gen() % 10;
+            for (auto window : windows) {
+                std::set<uint32_t> clients;
+                size_t rooms = 0;
+                for (auto const& b : seen) {
+                    if (b.hotel == hotel && b.time > now - window) {
+                        clients.insert(b.client);
+                        rooms += b.rooms;
+                    }
+                }
+                auto name = "h" + to_string(hotel);
+                ASSERT_EQUAL(ctx.rooms(name, window), rooms);
+                if (exact_clients)
+                    ASSERT_EQUAL(ctx.clients(name, window), clients.size());
+            }
+        }
+    }
+
+    // Too late bookings are booked at the tolerance boundary
+    ctx.book(now - 10 * tolerance, "late", 1, 7);
+    ASSERT_EQUAL(ctx.rooms("late", 600), 7);
+    ASSERT_EQUAL(ctx.current_time(), now);
+}
+
+void TestReorder() {
+    CheckReorder<hotel_processing::cached_context>(true);
+    CheckReorder<hotel_processing::lazy_context>(true);
+    CheckReorder<hotel_processing::approx_context>(false);
+
+    // Tolerance is kept below the smallest window
+    hotel_processing::engine_options options;
+    options.reorder = 1000;
+    hotel_processing::context ctx{{100}, options};
+    ctx.book(1000, "a", 1, 1);
+    ctx.book(500, "a", 2, 1);
+    ASSERT_EQUAL(ctx.clients("a"), 2);
+    ctx.book(1099, "a", 3, 1);
+    ASSERT_EQUAL(ctx.clients("a"), 2);
+    ctx.book(1100, "b", 1, 1);
+    ASSERT_EQUAL(ctx.clients("a"), 1);
+}
+
+template<typename Context>
+void CheckCoalesce() {
+    Context ctx{{100, 10}};
+    for (int i = 0; i < 1000; ++i) {
+        for (uint32_t client : {1, 2, 1, 3, 2, 1})
+            ctx.book(i, "a", client, client);
+    }
+    ASSERT_EQUAL(ctx.rooms("a", 10), 10 * 10);
+    ASSERT_EQUAL(ctx.rooms("a", 100), 100 * 10);
+    ASSERT_EQUAL(ctx.clients("a", 10), 3);
+    // one entry per (time, client) pair
+    ASSERT_EQUAL(ctx.stored_bookings(), 3 * 100);
+
+    Context other{{100, 10}};
+    other.book(0, "a", 1, 1);
+    other.book(20, "a", 2, 2);
+    ASSERT_EQUAL(other.rooms("a", 10), 2);
+    other.book(20, "a", 2, 4);
+    ASSERT_EQUAL(other.stored_bookings(), 2);
+    // The booking of the same time and client has left the smaller window, it isn't merged
+    other.book(0, "a", 1, 8);
+    ASSERT_EQUAL(other.stored_bookings(), 3);
+    ASSERT_EQUAL(other.rooms("a", 100), 15);
+    other.book(200, "b", 1, 1);
+    ASSERT_EQUAL(other.rooms("a", 10), 0);
+    ASSERT_EQUAL(other.rooms("a", 100), 0);
+
+    // Many clients interleaved within a second still get one entry each
+    Context busy{{100, 10}};
+    for (int64_t tm = 0; tm < 50; ++tm) {
+        for (int round = 0; round < 4; ++round) {
+            for (uint32_t client = 0; client < 12; ++client)
+                busy.book(tm, "a", client, 1);
+        }
+    }
+    ASSERT_EQUAL(busy.stored_bookings(), 12 * 50);
+    ASSERT_EQUAL(busy.rooms("a", 10), 12 * 4 * 10);
+    ASSERT_EQUAL(busy.clients("a", 100), 12);
+
+    // Late bookings merge into the bookings of their time inside the log
+    hotel_processing::engine_options options;
+    options.reorder = 5;
+    Context late{{100, 10}, options};
+    for (int64_t tm = 0; tm < 50; ++tm) {
+        for (uint32_t client = 0; client < 12; ++client) {
+            late.book(tm, "a", client, 1);
+            late.book(std::max<int64_t>(tm - 3, 0), "a", client, 1);
+        }
+    }
+    ASSERT_EQUAL(late.stored_bookings(), 12 * 50);
+    ASSERT_EQUAL(late.rooms("a", 100), 12 * 2 * 50);
+}
+
+void TestCoalesce() {
+    CheckCoalesce<hotel_processing::cached_context>();
+    CheckCoalesce<hotel_processing::lazy_context>();
+    CheckCoalesce<hotel_processing::approx_context>();
+}
+
+template<typename Context>
+void CheckMemory(const string& path) {
+    using hotel_processing::allocator_kind;
+    const vector<int64_t> windows = {600, 3600};
+    hotel_processing::engine_options options;
+    options.history = 7200;
+
+    // Answers don't depend on where the hotels allocate from
+    for (auto memory : {hotel_processing::memory_options{allocator_kind::pool, false},
+                        hotel_processing::memory_options{allocator_kind::arena, false},
+                        hotel_processing::memory_options{allocator_kind::pool, true},
+                        hotel_processing::memory_options{allocator_kind::arena, true}}) {
+        Context expected{windows, options};
+        Context ctx{windows, options, memory};
+        std::mt19937 gen{7};
+        int64_t tm = 0;
+        auto run = [&](Context& ctx, int count) {
+            for (int i = 0; i < count; ++i) {
+                tm += gen() % 5;
+                auto hotel = "h" + to_string(gen() % 50);
+                auto client = uint32_t(gen() % 100), rooms = uint32_t(gen() % 4);
+                expected.book(tm, hotel, client, rooms);
+                ctx.book(tm, hotel, client, rooms);
+                if (i % 10 == 0) {
+                    ASSERT_EQUAL(ctx.clients(hotel, 600), expected.clients(hotel, 600));
+                    ASSERT_EQUAL(ctx.rooms(hotel, 3600), expected.rooms(hotel, 3600));
+                    ASSERT_EQUAL(ctx.clients(hotel, tm - 5000, tm),
+                                 expected.clients(hotel, tm - 5000, tm));
+                }
+            }
+        };
+        run(ctx, 20000);
+
+        // Loaded state lives in the new resource, the old one is released after the hotels
+        ASSERT(ctx.save(path.c_str()));
+        Context restored{windows, {}, memory};
+        restored.book(0, "x", 1, 1);
+        ASSERT(restored.load(path.c_str()));
+        std::filesystem::remove(path);
+        run(restored, 20000);
+        ASSERT_EQUAL(restored.stored_bookings(), expected.stored_bookings());
+
+        // Cleared context starts over in the released memory, at the same current time
+        restored.clear();
+        ASSERT_EQUAL(restored.hotels_count(), 0);
+        ASSERT_EQUAL(restored.stored_bookings(), 0);
+        ASSERT_EQUAL(restored.rooms("h1"), 0);
+        ASSERT(restored.top_rooms(5).empty());
+        Context fresh{windows, options};
+        fresh.set_time(restored.current_time());
+        expected = std::move(fresh);
+        run(restored, 20000);
+        ASSERT_EQUAL(restored.stored_bookings(), expected.stored_bookings());
+    }
+}
+
+void TestMemory() {
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_memory_test").string();
+    CheckMemory<hotel_processing::cached_context>(path);
+    CheckMemory<hotel_processing::lazy_context>(path);
+    CheckMemory<hotel_processing::approx_context>(path);
+
+    ASSERT(hotel_processing::parse_allocator("pool") == hotel_processing::allocator_kind::pool);
+    ASSERT(!hotel_processing::parse_allocator("malloc"));
+}
+
+template<typename Context>
+void CheckTopK(const string& path, int64_t reorder) {
+    using hotel_processing::ranked_hotel;
+    const vector<int64_t> windows = {600, 3600};
+    hotel_processing::engine_options options;
+    options.reorder = reorder;
+    Context ctx{windows, options};
+    std::mt19937 gen{11};
+    int64_t tm = 0;
+
+    // Reference: every hotel queried, best first, equal values by lower ID
+    auto expected = [](Context& ctx, bool rooms, size_t k, int64_t window) {
+        vector<ranked_hotel> all;
+        for (uint32_t id = 0; id < ctx.hotels_count(); ++id) {
+            auto value = rooms ? ctx.rooms(id, window) : ctx.clients(id, window);
+            if (value)
+                all.push_back({id, value});
+        }
+        std::stable_sort(all.begin(), all.end(),
+                         [](auto const& a, auto const& b) { return a.value > b.value; });
+        all.resize(std::min(k, all.size()));
+        return all;
+    };
+    auto check = [&](Context& ctx) {
+        for (size_t k : {size_t(1), size_t(5), size_t(100)}) {
+            for (auto window : windows) {
+                auto rooms = ctx.top_rooms(k, window), clients = ctx.top_clients(k, window);
+                auto want_rooms = expected(ctx, true, k, window);
+                auto want_clients = expected(ctx, false, k, window);
+                ASSERT_EQUAL(rooms.size(), want_rooms.size());
+                ASSERT_EQUAL(clients.size(), want_clients.size());
+                for (size_t i = 0; i < rooms.size(); ++i) {
+                    ASSERT_EQUAL(rooms[i].hotel, want_rooms[i].hotel);
+                    ASSERT_EQUAL(rooms[i].value, want_rooms[i].value);
+                }
+                for (size_t i = 0; i < clients.size(); ++i) {
+                    ASSERT_EQUAL(clients[i].hotel, want_clients[i].hotel);
+                    ASSERT_EQUAL(clients[i].value, want_clients[i].value);
+                }
+            }
+        }
+        ASSERT_EQUAL(ctx.top_rooms(3).size(), expected(ctx, true, 3, 600).size());
+    };
+    auto run = [&](Context& ctx, int count) {
+        for (int i = 0; i < count; ++i) {
+            tm += gen() % 7;
+            // burst of bookings and then a pause, so hotels leave the windows for good
+            if (i % 2000 == 1999)
+                tm += 4000;
+            auto time = tm - (reorder ? int64_t(gen() % uint32_t(reorder)) : 0);
+            ctx.book(time, "h" + to_string(gen() % 40), uint32_t(gen() % 30),
+                     uint32_t(gen() % 4 + 1));
+            if (i % 150 == 0)
+                check(ctx);
+        }
+    };
+    run(ctx, 6000);
+
+    ASSERT(ctx.top_rooms(10, 1234).empty());
+    ASSERT(ctx.top_clients(0).empty());
+
+    // Ranking is rebuilt on load
+    ASSERT(ctx.save(path.c_str()));
+    Context restored{windows, options};
+    ASSERT(restored.load(path.c_str()));
+    std::filesystem::remove(path);
+    check(restored);
+    run(restored, 3000);
+
+    // Everything expires without further bookings
+    restored.set_time(tm + 10000);
+    ASSERT(restored.top_rooms(10, 3600).empty());
+    ASSERT(restored.top_clients(10).empty());
+}
+
+void TestTopK() {
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_top_test").string();
+    for (int64_t reorder : {0, 30}) {
+        CheckTopK<hotel_processing::cached_context>(path, reorder);
+        CheckTopK<hotel_processing::lazy_context>(path, reorder);
+        CheckTopK<hotel_processing::approx_context>(path, reorder);
+    }
+
+    hotel_processing::priv::indexed_heap<int, std::greater<>> heap;
+    std::map<uint32_t, int> reference;
+    std::mt19937 gen(5);
+    for (int i = 0; i < 5000; ++i) {
+        auto id = uint32_t(gen() % 300);
+        if (gen() % 4 == 0) {
+            heap.erase(id);
+            reference.erase(id);
+        } else {
+            auto key = int(gen() % 50);
+            heap.set(id, key);
+            reference[id] = key;
+        }
+        ASSERT_EQUAL(heap.size(), reference.size());
+    }
+    vector<std::pair<int, uint32_t>> order;
+    for (auto [id, key] : reference)
+        order.push_back({-key, id});
+    std::sort(order.begin(), order.end());
+    size_t pos = 0;
+    heap.for_each_first(50, [&](uint32_t id, int key) {
+        ASSERT_EQUAL(id, order[pos].second);
+        ASSERT_EQUAL(key, -order[pos].first);
+        ++pos;
+    });
+    ASSERT_EQUAL(pos, 50);
+    ASSERT_EQUAL(heap.top(), order[0].second);
+    ASSERT(heap.contains(order[0].second));
+    heap.clear();
+    ASSERT(heap.empty());
+}
+
+void TestBookingLog() {
+    hotel_processing::priv::bookings_t log;
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 1000; ++i)
+            log.push_back(round * 1000 + i, i, 1);
+        // keep the tail only: forces wrap-around and shrinking
+        log.pop_front(log.size() - 10);
+        ASSERT_EQUAL(log.size(), 10);
+        ASSERT_EQUAL(log.time(0), round * 1000 + 990);
+        ASSERT(log.capacity() <= 32);
+    }
+
+    ASSERT_EQUAL(log.upper_bound(2994), 5);
+    ASSERT_EQUAL(log.upper_bound(0), 0);
+    ASSERT_EQUAL(log.upper_bound(5000), 10);
+
+    size_t rooms = 0;
+    log.for_each_segment(3, [&rooms](auto clients, auto r) {
+        ASSERT_EQUAL(clients.size(), r.size());
+        rooms += r.size();
+    });
+    ASSERT_EQUAL(rooms, 7);
+
+    log.clear();
+    ASSERT(log.empty());
+
+    // Narrow while the values fit, extreme ones widen the column until they are evicted
+    ASSERT_EQUAL(log.slot_size(), 10);
+    const int64_t far = 1'000'000'000'000'000'000;
+    log.push_back(-far, 1, 3);
+    log.push_back(-far + 10, 2, 70000);
+    log.push_back(far, 3, 5);
+    log.insert_sorted(-far + 5, 4, 6);
+    ASSERT(log.slot_size() > 10);
+    ASSERT_EQUAL(log.time(0), -far);
+    ASSERT_EQUAL(log.time(1), -far + 5);
+    ASSERT_EQUAL(log.time(2), -far + 10);
+    ASSERT_EQUAL(log.time(3), far);
+    ASSERT_EQUAL(log.rooms(1), 6);
+    ASSERT_EQUAL(log.rooms(2), 70000);
+    ASSERT_EQUAL(log.client(3), 3);
+    log.pop_front(3);
+    for (int i = 0; i < 100; ++i)
+        log.push_back(far + i, i, i);
+    log.pop_front(90);
+    ASSERT_EQUAL(log.slot_size(), 10);
+    ASSERT_EQUAL(log.time(0), far + 89);
+    ASSERT_EQUAL(log.rooms(10), 99);
+    ASSERT_EQUAL(log.upper_bound(far + 95), 7);
+}
+
+void TestFlatMap() {
+    hotel_processing::priv::flat_map map;
+    std::unordered_map<uint32_t, uint32_t> reference;
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<uint32_t> random_key(0, 2000);
+
+    for (int i = 0; i < 200'000; ++i) {
+        auto key = random_key(gen);
+        if (gen() % 3 && reference.count(key)) {
+            auto value = map.decrement(key);
+            if (--reference[key] == 0)
+                reference.erase(key);
+            ASSERT_EQUAL(value, reference.count(key) ? reference[key] : 0);
+        } else {
+            ASSERT_EQUAL(map.increment(key), ++reference[key]);
+        }
+        ASSERT_EQUAL(map.size(), reference.size());
+    }
+
+    for (uint32_t key = 0; key <= 2000; ++key) {
+        ASSERT_EQUAL(map.find(key), reference.count(key) ? reference[key] : 0);
+    }
+
+    map.set(0xFFFFFFFF, 7);
+    ASSERT_EQUAL(map.find(0xFFFFFFFF), 7u);
+    map.erase(0xFFFFFFFF);
+    ASSERT_EQUAL(map.find(0xFFFFFFFF), 0u);
+    ASSERT_EQUAL(map.size(), reference.size());
+
+    for (auto const& [key, value] : reference) {
+        for (uint32_t i = 0; i < value; ++i)
+            map.decrement(key);
+    }
+    ASSERT(map.empty());
+    ASSERT(map.capacity() <= hotel_processing::priv::flat_map::KEEP_CAPACITY);
+}
+
+void TestParser() {
+    string input = "6\n"
+                   "BOOK 1000000000000000000 mariott 4294967295 12345678901\n"
+                   "BOOK -999999999999999999 hilton 0 1\r\n"
+                   "CLIENTS mariott\n"
+                   "ROOMS  hilton\n"
+                   "UNKNOWN x\n"
+                   "BOOK 7 a 12 3";
+    hotel_processing::request_parser parser{input};
+    hotel_processing::request req;
+
+    ASSERT_EQUAL(parser.count(), 6);
+
+    ASSERT(parser.next(req));
+    ASSERT(req.kind == hotel_processing::request_kind::book);
+    ASSERT_EQUAL(req.time, 1000000000000000000);
+    ASSERT_EQUAL(req.hotel, "mariott");
+    ASSERT_EQUAL(req.client, 4294967295u);
+    ASSERT_EQUAL(req.rooms, 12345678901u);
+
+    ASSERT(parser.next(req));
+    ASSERT_EQUAL(req.time, -999999999999999999);
+    ASSERT_EQUAL(req.hotel, "hilton");
+    ASSERT_EQUAL(req.client, 0u);
+    ASSERT_EQUAL(req.rooms, 1u);
+
+    ASSERT(parser.next(req));
+    ASSERT(req.kind == hotel_processing::request_kind::clients);
+    ASSERT_EQUAL(req.hotel, "mariott");
+
+    ASSERT(parser.next(req));
+    ASSERT(req.kind == hotel_processing::request_kind::rooms);
+    ASSERT_EQUAL(req.hotel, "hilton");
+
+    ASSERT(parser.next(req));
+    ASSERT(req.kind == hotel_processing::request_kind::unknown);
+
+    ASSERT(parser.next(req));
+    ASSERT(req.kind == hotel_processing::request_kind::book);
+    ASSERT_EQUAL(req.time, 7);
+    ASSERT_EQUAL(req.hotel, "a");
+    ASSERT_EQUAL(req.client, 12u);
+    ASSERT_EQUAL(req.rooms, 3u);
+
+    ASSERT(!parser.next(req));
+}
+
+void TestOutputWriter() {
+    vector<size_t> values = {0, 1, 9, 10, 99, 100, 12345, 999999999, 1000000000,
+                             numeric_limits<uint32_t>::max(), numeric_limits<uint64_t>::max()};
+    for (uint64_t p = 1; p && p <= numeric_limits<uint64_t>::max() / 10; p *= 10) {
+        values.push_back(p - 1);
+        values.push_back(p);
+        values.push_back(p + 1);
+    }
+    std::mt19937_64 gen(3);
+    for (size_t i = 0; i < 100'000; ++i) {
+        values.push_back(gen() >> (gen() % 64));
+    }
+
+    for (size_t columns : {1, 3}) {
+        ostringstream out;
+        string expected;
+        {
+            hotel_processing::output_writer writer{out};
+            writer.answers(values, columns);
+            writer.number(42);
+            writer.put('\n');
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            expected += to_string(values[i]);
+            expected += (i + 1) % columns ? ' ' : '\n';
+        }
+        expected += "42\n";
+        ASSERT(out.str().size() > hotel_processing::output_writer::CAPACITY);
+        ASSERT(out.str() == expected);
+    }
+}
+
+void TestBinlog() {
+    string input = "7\n"
+                   "BOOK 100 mariott 7 2\n"
+                   "BOOK 5000000000 hilton 8 3\n"
+                   "CLIENTS ritz\n"
+                   "BOOK 5000000010 mariott 9 1\n"
+                   "UNKNOWN x\n"
+                   "BOOK -5 hilton 10 4\n"
+                   "ROOMS hilton\n";
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_binlog_test").string();
+    ASSERT(hotel_processing::write_binlog(input, path.c_str()));
+
+    hotel_processing::input_buffer buffer;
+    ASSERT(buffer.open(path.c_str()));
+    std::filesystem::remove(path);
+    ASSERT(hotel_processing::is_binlog(buffer.data()));
+    ASSERT(!hotel_processing::is_binlog(input));
+
+    hotel_processing::binlog_reader log;
+    ASSERT(log.open(buffer.data()));
+    ASSERT(!log.open(buffer.data().substr(0, buffer.data().size() - 1)));
+
+    // Hotel count that can't fit the dictionary
+    string malformed{buffer.data()};
+    hotel_processing::binlog_header header;
+    std::memcpy(&header, malformed.data(), sizeof(header));
+    header.hotels = 0xFFFFFFFF;
+    std::memcpy(malformed.data(), &header, sizeof(header));
+    ASSERT(!log.open(malformed));
+    ASSERT(log.open(buffer.data()));
+
+    ASSERT_EQUAL(log.hotels(), 3u);
+    ASSERT_EQUAL(log.hotel_name(0), "mariott");
+    ASSERT_EQUAL(log.hotel_name(2), "ritz");
+
+    // Times are restored from deltas and escaped absolute times
+    using kind = hotel_processing::binlog_kind;
+    vector<int64_t> times;
+    vector<kind> kinds;
+    auto time = log.base_time();
+    for (auto const& rec : log.records()) {
+        if (rec.kind() == kind::time) {
+            time = rec.time();
+            continue;
+        }
+        kinds.push_back(rec.kind());
+        if (rec.kind() == kind::book) {
+            time += rec.delta();
+            times.push_back(time);
+        }
+    }
+    ASSERT(kinds == vector<kind>({kind::book, kind::book, kind::clients, kind::book, kind::book,
+                                  kind::rooms}));
+    ASSERT_EQUAL(times, vector<int64_t>({100, 5000000000, 5000000010, -5}));
+    ASSERT_EQUAL(log.records().back().hotel, 1u);
+
+    // Replay queries find hotels the context knows from a snapshot, only bookings register them
+    auto snapshot =
+        (std::filesystem::temp_directory_path() / "hotel_processing_replay_test").string();
+    hotel_processing::cached_context saved;
+    saved.book(5000000000, "ritz", 1, 6);
+    ASSERT(saved.save(snapshot.c_str()));
+    hotel_processing::cached_context ctx;
+    ASSERT(ctx.load(snapshot.c_str()));
+    std::filesystem::remove(snapshot);
+
+    hotel_processing::binlog_hotels ids{ctx, log};
+    auto ritz = ids.query(2);
+    ASSERT_EQUAL(ritz, *ctx.find("ritz"));
+    ASSERT_EQUAL(ctx.rooms(ritz), 6);
+    ASSERT_EQUAL(ids.query(0), hotel_processing::INVALID_HOTEL);
+    ASSERT_EQUAL(ctx.hotels_count(), 1);
+    auto mariott = ids.book(0);
+    ASSERT_EQUAL(ids.query(0), mariott);
+    ASSERT_EQUAL(ctx.hotel_name(mariott), "mariott");
+}
+
+void TestSharded() {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> random_hotel(0, 30);
+    std::uniform_int_distribution<int> random_kind(0, 9);
+    std::uniform_int_distribution<int> random_step(0, 20000);
+
+    const size_t count = 50'000;
+    ostringstream input;
+    input << count << '\n';
+    int64_t tm = 0;
+    for (size_t i = 0; i < count; ++i) {
+        auto kind = random_kind(gen);
+        auto hotel = "h" + to_string(random_hotel(gen));
+        if (kind < 6) {
+            tm += random_step(gen);
+            input << "BOOK " << tm << ' ' << hotel << ' ' << gen() % 100 << ' ' << gen() % 10 << '\n';
+        } else {
+            input << (kind < 8 ? "CLIENTS " : "ROOMS ") << hotel << '\n';
+        }
+    }
+    auto data = input.str();
+
+    ostringstream expected;
+    {
+        hotel_processing::context ctx;
+        hotel_processing::request_parser parser{data};
+        hotel_processing::request req;
+        parser.count();
+        while (parser.next(req)) {
+            if (req.kind == hotel_processing::request_kind::book)
+                ctx.book(req.time, req.hotel, req.client, req.rooms);
+            else if (req.kind == hotel_processing::request_kind::clients)
+                expected << ctx.clients(req.hotel) << '\n';
+            else if (req.kind == hotel_processing::request_kind::rooms)
+                expected << ctx.rooms(req.hotel) << '\n';
+        }
+    }
+
+    const int64_t window = hotel_processing::TIME_WINDOW;
+    for (unsigned shards : {1, 2, 5}) {
+        ostringstream out;
+        hotel_processing::process_sharded(data, shards, {&window, 1}, hotel_processing::DEFAULT_ENGINE, {},
+                                          out);
+        ASSERT(out.str() == expected.str());
+    }
+}
+
+// Connects to the server socket, retrying while it's being set up
+int ConnectSession(const string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strcpy(addr.sun_path, path.c_str());
+    for (int attempt = 0; attempt < 500; ++attempt) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+            return fd;
+        ::close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Sends the parts one by one, then reads everything until the server closes the session
+string RunSession(int fd, const vector<string>& parts,
+                  std::chrono::milliseconds pause = std::chrono::milliseconds(5)) {
+    for (auto const& part : parts) {
+        if (::send(fd, part.data(), part.size(), MSG_NOSIGNAL) != ssize_t(part.size()))
+            break;
+        std::this_thread::sleep_for(pause);
+    }
+    ::shutdown(fd, SHUT_WR);
+    string out;
+    char buffer[256];
+    for (ssize_t ret; (ret = ::recv(fd, buffer, sizeof(buffer), 0)) > 0;)
+        out.append(buffer, size_t(ret));
+    ::close(fd);
+    return out;
+}
+
+void TestServer() {
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_server_test").string();
+    hotel_processing::context ctx{{10, 100}};
+    volatile std::sig_atomic_t stop = 0;
+    bool served = false;
+    std::thread server{[&] { served = hotel_processing::serve(ctx, path.c_str(), stop); }};
+
+    int first = ConnectSession(path);
+    int second = ConnectSession(path);
+    string first_out, second_out;
+    if (first >= 0 && second >= 0) {
+        // Sessions share the context, a request may be split between reads
+        first_out = RunSession(first, {"BOOK 1 a 1 2\nBOOK 5 a 2 3\nCLIE", "NTS a\nROOMS a\n",
+                                       "BOOK 12 a 3 1\nROOMS a\nUNKNOWN a\nCLIENTS b"});
+        second_out = RunSession(second, {"ROOMS a\n"});
+    }
+    stop = 1;
+    server.join();
+
+    ASSERT(served);
+    ASSERT_EQUAL(first_out, "2 2\n5 5\n4 6\n0 0\n");
+    ASSERT_EQUAL(second_out, "4 6\n");
+    ASSERT(!std::filesystem::exists(path));
+    ASSERT_EQUAL(ctx.clients("a", 100), 3);
+}
+
+void TestServerReschedule() {
+    auto path = (std::filesystem::temp_directory_path() / "hotel_processing_server_test").string();
+    hotel_processing::context ctx{{10, 100}};
+    volatile std::sig_atomic_t stop = 0;
+    bool served = false;
+    // Every read reschedules the session and drains only a few lines, so input arriving meanwhile
+    // wakes up sessions that already wait on the ready list
+    hotel_processing::server_options options;
+    options.input_capacity = 32;
+    options.max_turn_reads = 1;
+    std::thread server{[&] { served = hotel_processing::serve(ctx, path.c_str(), stop, {}, options); }};
+
+    const int parts = 10, part_lines = 1000;
+    vector<string> out(3);
+    for (size_t round = 0; round < out.size(); ++round) {
+        auto hotel = "h" + std::to_string(round);
+        vector<string> input;
+        for (int part = 0, client = 0; part < parts; ++part) {
+            string lines;
+            for (int i = 0; i < part_lines; ++i)
+                lines += "BOOK 1 " + hotel + ' ' + std::to_string(client++) + " 1\n";
+            input.push_back(std::move(lines));
+        }
+        input.back() += "ROOMS " + hotel + "\nCLIENTS " + hotel + '\n';
+
+        int fd = ConnectSession(path);
+        if (fd >= 0)
+            out[round] = RunSession(fd, input, std::chrono::milliseconds(1));
+    }
+    stop = 1;
+    server.join();
+
+    ASSERT(served);
+    auto total = std::to_string(parts * part_lines);
+    for (auto const& answers : out)
+        ASSERT_EQUAL(answers, total + ' ' + total + '\n' + total + ' ' + total + '\n');
+}
+
 int main()
 {
     test_runner tr;
@@ -249,6 +1462,29 @@ int main()
     RUN_TEST(tr, Test4);
     RUN_TEST(tr, Test5);
     RUN_TEST(tr, Test6);
+    RUN_TEST(tr, TestHotelIds);
+    RUN_TEST(tr, TestBatches);
+    RUN_TEST(tr, TestReclaim);
+    RUN_TEST(tr, TestWindows);
+    RUN_TEST(tr, TestApproximateClients);
+    RUN_TEST(tr, TestEngines);
+    RUN_TEST(tr, TestSnapshot);
+    RUN_TEST(tr, TestHistory);
+    RUN_TEST(tr, TestReorder);
+    RUN_TEST(tr, TestCoalesce);
+    RUN_TEST(tr, TestMemory);
+    RUN_TEST(tr, TestTopK);
+    RUN_TEST(tr, TestConcurrent);
+    RUN_TEST(tr, TestConcurrentSameHotel);
+    RUN_TEST(tr, TestStats);
+    RUN_TEST(tr, TestBookingLog);
+    RUN_TEST(tr, TestFlatMap);
+    RUN_TEST(tr, TestParser);
+    RUN_TEST(tr, TestOutputWriter);
+    RUN_TEST(tr, TestBinlog);
+    RUN_TEST(tr, TestSharded);
+    RUN_TEST(tr, TestServer);
+    RUN_TEST(tr, TestServerReschedule);
     //RUN_TEST(tr, TimeTest);
 
     return 0;
@@ -6,6 +6,8 @@
 #include <map>
 #include <set>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <chrono>
 
@@ -78,9 +80,21 @@ ostream& operator << (ostream& os, const map<K, V>& m) {
     return os << "}";
 }
 
+// Integers of any signedness compare by value, like `size_t` results against int literals
+template<class T, class U>
+bool AreEqual(const T& t, const U& u) {
+    constexpr bool is_number = is_integral_v<T> && is_integral_v<U> && !is_same_v<T, bool> &&
+                               !is_same_v<U, bool> && !is_same_v<T, char> && !is_same_v<U, char>;
+    if constexpr (is_number) {
+        return cmp_equal(t, u);
+    } else {
+        return t == u;
+    }
+}
+
 template<class T, class U>
 void AssertEqual(const T& t, const U& u, const string& hint = {}) {
-    if (!(t == u)) {
+    if (!AreEqual(t, u)) {
         ostringstream os;
         os << "Assertion failed: " << t << " != " << u;
         if (!hint.empty()) {